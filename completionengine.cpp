@@ -0,0 +1,289 @@
+#include "completionengine.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileSystemWatcher>
+#include <QThread>
+#include <QTimer>
+#include <algorithm>
+#include <utility>
+#include <dirent.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+CompletionEngine::CompletionEngine(QObject *parent) : QObject(parent) {}
+
+CompletionEngine::~CompletionEngine() {
+    // Scans still queued are dropped; one in progress is waited for.
+    if (scanThread) {
+        scanThread->quit();
+        scanThread->wait();
+    }
+}
+
+void CompletionEngine::watch(const QString &dir) {
+    // Created here rather than in the constructor so its inotify notifier
+    // belongs to the worker thread.
+    if (!watcher) {
+        watcher = new QFileSystemWatcher(this);
+        connect(watcher, &QFileSystemWatcher::directoryChanged,
+                this, &CompletionEngine::handleDirectoryChanged);
+    }
+    if (!watchedDirs.contains(dir) && watcher->addPath(dir)) {
+        watchedDirs.insert(dir);
+    }
+}
+
+void CompletionEngine::unwatch(const QString &dir) {
+    if (watcher && watchedDirs.remove(dir)) {
+        watcher->removePath(dir);
+    }
+}
+
+void CompletionEngine::buildPathIndex() {
+    pathDirs = QString::fromLocal8Bit(qgetenv("PATH")).split(':', Qt::SkipEmptyParts);
+    pathDirIndex.clear();
+
+    for (const QString &dir : pathDirs) {
+        // Watch before listing so a change made mid-scan isn't missed.
+        watch(dir);
+    }
+    scanPathDirs(pathDirs);
+}
+
+void CompletionEngine::scanPathDirs(const QStringList &dirs) {
+    if (!scanThread) {
+        scanThread = new QThread(this);
+        scanContext = new QObject; // No parent: it's moved to the thread
+        scanContext->moveToThread(scanThread);
+        connect(scanThread, &QThread::finished, scanContext, &QObject::deleteLater);
+        scanThread->start(QThread::LowPriority);
+    }
+
+    // One task per directory, so each is merged as soon as it's read and a
+    // hung mount only holds back the dirs queued after it.
+    for (const QString &dir : dirs) {
+        ++pendingPathScans;
+        QMetaObject::invokeMethod(scanContext, [engine = this, dir](){
+            const QStringList names = scanExecutables(dir);
+            QMetaObject::invokeMethod(engine, [engine, dir, names](){
+                engine->pathDirScanned(dir, names);
+            }, Qt::QueuedConnection);
+        }, Qt::QueuedConnection);
+    }
+}
+
+void CompletionEngine::pathDirScanned(const QString &dir, const QStringList &names) {
+    --pendingPathScans;
+    if (!pathDirs.contains(dir)) return;
+    pathDirIndex.insert(dir, names);
+    mergePathIndex();
+}
+
+QStringList CompletionEngine::scanExecutables(const QString &dir) {
+    QStringList names;
+    DIR *d = opendir(QFile::encodeName(dir).constData());
+    if (!d) return names;
+
+    while (struct dirent *entry = readdir(d)) {
+        if (entry->d_type == DT_DIR || entry->d_name[0] == '.') continue;
+
+        // Symlinks and filesystems without d_type need a stat to rule
+        // out directories.
+        if (entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN) {
+            struct stat st;
+            if (fstatat(dirfd(d), entry->d_name, &st, 0) != 0 || S_ISDIR(st.st_mode)) continue;
+        }
+        if (faccessat(dirfd(d), entry->d_name, X_OK, 0) != 0) continue;
+
+        names.append(QFile::decodeName(entry->d_name));
+    }
+    closedir(d);
+    return names;
+}
+
+void CompletionEngine::mergePathIndex() {
+    // In-memory only: no directory is touched here.
+    pathIndex.clear();
+    for (const QStringList &names : std::as_const(pathDirIndex)) {
+        pathIndex.append(names);
+    }
+    pathIndex.sort();
+    pathIndex.erase(std::unique(pathIndex.begin(), pathIndex.end()), pathIndex.end());
+
+    if (pendingPathScans == 0) {
+        qDebug() << "Indexed" << pathIndex.size() << "executables from PATH.";
+    }
+}
+
+void CompletionEngine::rescanChangedPathDirs() {
+    // Only the directories inotify reported; the old entries keep
+    // answering until the new ones are in.
+    const QStringList dirs(changedPathDirs.cbegin(), changedPathDirs.cend());
+    changedPathDirs.clear();
+    scanPathDirs(dirs);
+}
+
+const QStringList *CompletionEngine::listDirectory(const QString &dir) {
+    auto cached = dirCache.constFind(dir);
+    if (cached != dirCache.constEnd()) {
+        dirCacheOrder.removeOne(dir);
+        dirCacheOrder.append(dir);
+        return &cached.value();
+    }
+
+    watch(dir);
+
+    DIR *d = opendir(QFile::encodeName(dir).constData());
+    if (!d) {
+        if (!pathDirs.contains(dir)) unwatch(dir);
+        return nullptr;
+    }
+
+    QStringList entries;
+    while (struct dirent *entry = readdir(d)) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+        bool isDir = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN) {
+            struct stat st;
+            isDir = fstatat(dirfd(d), entry->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+        }
+
+        QString name = QFile::decodeName(entry->d_name);
+        if (isDir) name += '/';
+        entries.append(name);
+    }
+    closedir(d);
+    entries.sort();
+
+    cachedEntries += entries.size();
+    dirCache.insert(dir, entries);
+    dirCacheOrder.append(dir);
+    evictListings();
+
+    cached = dirCache.constFind(dir);
+    return cached != dirCache.constEnd() ? &cached.value() : nullptr;
+}
+
+void CompletionEngine::dropListing(const QString &dir) {
+    auto it = dirCache.find(dir);
+    if (it == dirCache.end()) return;
+    cachedEntries -= it.value().size();
+    dirCache.erase(it);
+    dirCacheOrder.removeOne(dir);
+}
+
+void CompletionEngine::evictListings() {
+    // Always keep the newest listing, however big, so it can be answered.
+    while (dirCacheOrder.size() > 1
+           && (cachedEntries > kMaxCachedEntries || dirCacheOrder.size() > kMaxCachedDirs)) {
+        const QString victim = dirCacheOrder.first();
+        dropListing(victim);
+        // Otherwise watches for long-gone listings pile up over a session
+        if (!pathDirs.contains(victim)) unwatch(victim);
+    }
+}
+
+void CompletionEngine::handleDirectoryChanged(const QString &path) {
+    dropListing(path);
+
+    if (pathDirs.contains(path)) {
+        // Package installs touch PATH dirs many times in a row; wait for
+        // them to settle, then rescan just the dirs that changed.
+        changedPathDirs.insert(path);
+        if (!pathRescanTimer) {
+            pathRescanTimer = new QTimer(this);
+            pathRescanTimer->setSingleShot(true);
+            pathRescanTimer->setInterval(kPathRescanDelayMs);
+            connect(pathRescanTimer, &QTimer::timeout,
+                    this, &CompletionEngine::rescanChangedPathDirs);
+        }
+        pathRescanTimer->start();
+    } else if (path == prefetchedDir) {
+        // Keep the shell's own directory warm. Builds write there
+        // constantly, so wait for a quiet moment before listing it again:
+        // every event pushes the relisting back.
+        if (!prefetchTimer) {
+            prefetchTimer = new QTimer(this);
+            prefetchTimer->setSingleShot(true);
+            prefetchTimer->setInterval(kPathRescanDelayMs);
+            connect(prefetchTimer, &QTimer::timeout, this, [this](){
+                listDirectory(prefetchedDir);
+            });
+        }
+        prefetchTimer->start();
+    } else {
+        unwatch(path);
+    }
+}
+
+int CompletionEngine::collectMatches(const QStringList &sorted, const QString &prefix,
+                                     const QString &outPrefix, QStringList &out, QString &common) {
+    // Matches form one contiguous run of the sorted list.
+    auto first = std::lower_bound(sorted.cbegin(), sorted.cend(), prefix);
+    auto last = std::partition_point(first, sorted.cend(), [&prefix](const QString &name){
+        return name.startsWith(prefix);
+    });
+
+    const bool showHidden = prefix.startsWith('.');
+    int matchCount = 0;
+    QString shared;
+
+    for (auto it = first; it != last; ++it) {
+        if (!showHidden && it->startsWith('.')) continue;
+
+        if (matchCount == 0) {
+            shared = *it;
+        } else {
+            int len = 0;
+            const int maxLen = qMin(shared.size(), it->size());
+            while (len < maxLen && shared.at(len) == it->at(len)) ++len;
+            shared.truncate(len);
+        }
+
+        if (out.size() < kMaxCandidates) out.append(outPrefix + *it);
+        ++matchCount;
+    }
+
+    common = outPrefix + shared;
+    return matchCount;
+}
+
+void CompletionEngine::prefetch(const QString &dir) {
+    prefetchedDir = QDir::cleanPath(dir);
+    listDirectory(prefetchedDir);
+}
+
+void CompletionEngine::complete(int requestId, const QString &word, const QString &baseDir,
+                                bool commandPosition) {
+    QStringList candidates;
+    QString common;
+    int matchCount = 0;
+
+    if (commandPosition && !word.contains('/')) {
+        matchCount = collectMatches(pathIndex, word, QString(), candidates, common);
+    } else {
+        // Split "src/ma" into the directory to list and the name prefix,
+        // keeping the directory part exactly as typed for the result.
+        const int slash = word.lastIndexOf('/');
+        const QString dirPart = word.left(slash + 1);
+        const QString namePrefix = word.mid(slash + 1);
+
+        QString dir = dirPart;
+        if (dir.startsWith("~/")) {
+            dir = QDir::homePath() + dir.mid(1);
+        } else if (!dir.startsWith('/')) {
+            dir = (baseDir.isEmpty() ? QDir::homePath() : baseDir) + '/' + dir;
+        }
+        dir = QDir::cleanPath(dir);
+
+        if (const QStringList *entries = listDirectory(dir)) {
+            matchCount = collectMatches(*entries, namePrefix, dirPart, candidates, common);
+        }
+    }
+
+    emit completionsReady(requestId, word, matchCount > 0 ? common : word,
+                          candidates, matchCount);
+}
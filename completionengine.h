@@ -0,0 +1,104 @@
+#ifndef COMPLETIONENGINE_H
+#define COMPLETIONENGINE_H
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+
+class QFileSystemWatcher;
+class QThread;
+class QTimer;
+
+// Tab completion for the input box. Lives on a worker thread (see
+// MainWindow) so slow or huge directories never stall typing. Answers
+// come from a sorted PATH executable index and a cache of directory
+// listings; QFileSystemWatcher (inotify on Linux) drops stale entries
+// instead of rescanning on every request.
+class CompletionEngine : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CompletionEngine(QObject *parent = nullptr);
+    ~CompletionEngine();
+
+public slots:
+    // Scan $PATH. Call once the engine is on its thread. The directories
+    // are read on scanThread; until each one is in, complete() answers from
+    // the ones already merged.
+    void buildPathIndex();
+
+    // word is unescaped; relative paths are resolved against baseDir.
+    // commandPosition completes executables as well as paths.
+    void complete(int requestId, const QString &word, const QString &baseDir,
+                  bool commandPosition);
+
+    // Lists dir ahead of the first Tab there; MainWindow calls this whenever
+    // the shell's directory changes.
+    void prefetch(const QString &dir);
+
+signals:
+    // completion is the longest common prefix of all matches (including
+    // word itself). candidates is capped at kMaxCandidates; matchCount
+    // is the uncapped total.
+    void completionsReady(int requestId, const QString &word, const QString &completion,
+                          const QStringList &candidates, int matchCount);
+
+private slots:
+    void handleDirectoryChanged(const QString &path);
+
+private:
+    QFileSystemWatcher *watcher = nullptr;
+
+    QStringList pathDirs;
+    QHash<QString, QStringList> pathDirIndex; // PATH dir -> its executables
+    QStringList pathIndex;      // sorted, unique executable names of all dirs
+
+    // PATH dirs inotify reported, rescanned once pathRescanTimer fires
+    QSet<QString> changedPathDirs;
+    QTimer *pathRescanTimer = nullptr;
+
+    // PATH may list slow network mounts. They are read here, never on
+    // our own thread, so a Tab press doesn't wait for them.
+    QThread *scanThread = nullptr;
+    QObject *scanContext = nullptr; // Lives on scanThread
+    int pendingPathScans = 0;
+
+    // Directory -> sorted entry names, directories suffixed with '/'.
+    // dirCacheOrder is least recently used first; an evicted listing
+    // loses its inotify watch too.
+    QHash<QString, QStringList> dirCache;
+    QStringList dirCacheOrder;
+    int cachedEntries = 0;
+    QSet<QString> watchedDirs;
+
+    // Last directory passed to prefetch(), re-listed once it has stopped
+    // changing for kPathRescanDelayMs
+    QString prefetchedDir;
+    QTimer *prefetchTimer = nullptr;
+
+    static QStringList scanExecutables(const QString &dir);
+    void scanPathDirs(const QStringList &dirs);
+    void pathDirScanned(const QString &dir, const QStringList &names);
+    void mergePathIndex();
+    void rescanChangedPathDirs();
+
+    void watch(const QString &dir);
+    void unwatch(const QString &dir);
+    const QStringList *listDirectory(const QString &dir);
+    void dropListing(const QString &dir);
+    void evictListings();
+
+    // Appends outPrefix + each entry of sorted that starts with prefix to out
+    // and sets common to outPrefix + their shared prefix. Returns the match
+    // count.
+    static int collectMatches(const QStringList &sorted, const QString &prefix,
+                              const QString &outPrefix, QStringList &out, QString &common);
+
+    static constexpr int kMaxCandidates = 200;
+    static constexpr int kMaxCachedEntries = 1000000;
+    static constexpr int kMaxCachedDirs = 64;
+    static constexpr int kPathRescanDelayMs = 500;
+};
+
+#endif // COMPLETIONENGINE_H
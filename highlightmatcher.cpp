@@ -0,0 +1,105 @@
+#include "highlightmatcher.h"
+#include <QQueue>
+#include <algorithm>
+
+void HighlightMatcher::compile(const QList<Rule> &rules) {
+    transitions.clear();
+    matchRule.clear();
+    matchLength.clear();
+    dictLink.clear();
+    ruleColors.clear();
+
+    // 1. Trie of all patterns. -1 marks a missing edge until step 2.
+    transitions.fill(-1, 256);
+    matchRule.append(-1);
+    matchLength.append(0);
+
+    for (const Rule &rule : rules) {
+        if (rule.pattern.isEmpty()) continue;
+
+        int state = 0;
+        for (const char ch : rule.pattern) {
+            const int slot = state * 256 + uchar(ch);
+            if (transitions[slot] < 0) {
+                transitions[slot] = matchRule.size();
+                transitions.resize(transitions.size() + 256, -1);
+                matchRule.append(-1);
+                matchLength.append(0);
+            }
+            state = transitions[slot];
+        }
+
+        // Duplicate patterns: the first rule wins
+        if (matchRule[state] < 0) {
+            matchRule[state] = ruleColors.size();
+            matchLength[state] = rule.pattern.size();
+        }
+        ruleColors.append(rule.color);
+    }
+
+    // 2. Breadth-first, fill in failure transitions so every state has an
+    //    edge for every byte, and link each state to the matches among its
+    //    suffixes.
+    QVector<int> failure(matchRule.size(), 0);
+    dictLink.fill(-1, matchRule.size());
+    QQueue<int> queue;
+    for (int byte = 0; byte < 256; ++byte) {
+        int &next = transitions[byte];
+        if (next < 0) {
+            next = 0;
+        } else {
+            queue.enqueue(next);
+        }
+    }
+
+    while (!queue.isEmpty()) {
+        const int state = queue.dequeue();
+        // The failure state is shallower, so its own link is already set.
+        const int suffix = failure[state];
+        if (suffix != 0) {
+            dictLink[state] = matchRule[suffix] >= 0 ? suffix : dictLink[suffix];
+        }
+
+        for (int byte = 0; byte < 256; ++byte) {
+            const int slot = state * 256 + byte;
+            const int fallback = transitions[failure[state] * 256 + byte];
+            if (transitions[slot] < 0) {
+                transitions[slot] = fallback;
+            } else {
+                failure[transitions[slot]] = fallback;
+                queue.enqueue(transitions[slot]);
+            }
+        }
+    }
+}
+
+QList<HighlightMatcher::Overlay> HighlightMatcher::scan(const char *data, int length) const {
+    QList<Overlay> overlays;
+    if (isEmpty()) return overlays;
+
+    // One DFA step per byte; note every match ending at each byte. Keeping
+    // only the longest would lose a shorter one the greedy pass needs
+    // (with "abc", "bcd" and "d", "abcd" highlights "abc" and "d").
+    QList<Overlay> candidates;
+    int state = 0;
+    for (int i = 0; i < length; ++i) {
+        state = transitions[state * 256 + uchar(data[i])];
+        int match = matchRule[state] >= 0 ? state : dictLink[state];
+        for (; match >= 0; match = dictLink[match]) {
+            const int len = matchLength[match];
+            candidates.append({ i - len + 1, len, ruleColors[matchRule[match]] });
+        }
+    }
+
+    // Leftmost first, longest on ties; drop anything overlapping a pick.
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Overlay &a, const Overlay &b){
+        return a.start < b.start || (a.start == b.start && a.length > b.length);
+    });
+    int coveredUntil = 0;
+    for (const Overlay &candidate : candidates) {
+        if (candidate.start < coveredUntil) continue;
+        overlays.append(candidate);
+        coveredUntil = candidate.start + candidate.length;
+    }
+    return overlays;
+}
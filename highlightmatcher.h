@@ -0,0 +1,49 @@
+#ifndef HIGHLIGHTMATCHER_H
+#define HIGHLIGHTMATCHER_H
+
+#include <QByteArray>
+#include <QColor>
+#include <QList>
+#include <QVector>
+
+// User highlight rules ("error:", "FAILED", service names...) compiled into
+// one Aho-Corasick automaton, so output is scanned once per byte no matter
+// how many rules there are. Patterns are matched as UTF-8 bytes,
+// case-sensitively.
+class HighlightMatcher
+{
+public:
+    struct Rule {
+        QByteArray pattern;
+        QColor color;
+    };
+
+    // A highlighted byte range of the scanned text
+    struct Overlay {
+        int start;
+        int length;
+        QColor color;
+    };
+
+    // Rebuilds the automaton. Empty patterns are ignored.
+    void compile(const QList<Rule> &rules);
+
+    bool isEmpty() const { return ruleColors.isEmpty(); }
+
+    // Leftmost-longest, non-overlapping matches in data, in order
+    QList<Overlay> scan(const char *data, int length) const;
+
+private:
+    // Dense DFA: transitions[state * 256 + byte] is the next state.
+    // State 0 is the root.
+    QVector<int> transitions;
+    // Per state: the rule whose whole pattern ends here, or -1
+    QVector<int> matchRule;
+    QVector<int> matchLength;
+    // Per state: the nearest shorter suffix state that has a matchRule, or
+    // -1. Following it visits every rule that ends at the current byte.
+    QVector<int> dictLink;
+    QVector<QColor> ruleColors;
+};
+
+#endif // HIGHLIGHTMATCHER_H
@@ -1,6 +1,11 @@
 #include "mainwindow.h"
+#include "sessiondaemon.h"
+#include "startuptrace.h"
 #include <QApplication>
 #include <QSettings> // <-- Add this
+#include <QTimer>
+#include <csignal>
+#include <unistd.h>
 
 void setDefaultSettings()
 {
@@ -26,21 +31,72 @@ void setDefaultSettings()
         settings.setValue("ansi/96", QColor("cyan"));
         settings.setValue("ansi/97", QColor(Qt::white));
     }
+
+    // Default highlight rules, editable in the settings dialog
+    if (!settings.contains("highlights/size")) {
+        const QList<QPair<QString, QColor>> rules = {
+            { "error:", QColor("orangered") },
+            { "FAILED", QColor("orangered") },
+            { "warning", QColor("gold") },
+        };
+        settings.beginWriteArray("highlights");
+        for (int i = 0; i < rules.size(); ++i) {
+            settings.setArrayIndex(i);
+            settings.setValue("pattern", rules[i].first);
+            settings.setValue("color", rules[i].second);
+        }
+        settings.endArray();
+    }
+}
+
+// `SplitTerm --daemon`: no GUI, just own the shells for the windows
+int runSessionDaemon(int argc, char *argv[])
+{
+    // Detach from whatever terminal or session launched us, so shells
+    // survive the GUI that started the daemon.
+    setsid();
+    signal(SIGHUP, SIG_IGN);
+
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setOrganizationName("MyCompany");
+    QCoreApplication::setApplicationName("SplitTerm");
+    setDefaultSettings();
+
+    SessionDaemon daemon;
+    if (!daemon.listen()) {
+        return 1;
+    }
+    return a.exec();
 }
 
 int main(int argc, char *argv[])
 {
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], "--daemon") == 0) {
+            return runSessionDaemon(argc, argv);
+        }
+        if (qstrcmp(argv[i], "--startup-trace") == 0) {
+            StartupTrace::enable();
+        }
+    }
+
     QApplication a(argc, argv);
+    StartupTrace::mark("QApplication created");
 
     // --- ADD THESE LINES ---
     QCoreApplication::setOrganizationName("MyCompany");
     QCoreApplication::setApplicationName("SplitTerm");
-
-    // Set default colors on first launch
-    setDefaultSettings();
     // --- END ADD ---
 
     MainWindow w;
+    StartupTrace::mark("main window constructed");
     w.show();
+    StartupTrace::mark("main window shown");
+
+    // Set default colors on first launch. Nothing reads them before the
+    // event loop runs, so keep the settings file off the path to the
+    // first frame.
+    QTimer::singleShot(0, &a, &setDefaultSettings);
+
     return a.exec();
 }
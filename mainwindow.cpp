@@ -1,17 +1,47 @@
 #include "mainwindow.h"
 #include "settingsdialog.h" // Include the new dialog
+#include "completionengine.h"
+#include "sessionsnapshot.h"
+#include "startuptrace.h"
 #include <QVBoxLayout>
 #include <QScrollBar>
 #include <QKeyEvent>
 #include <QTextCursor>
-#include <QTimer>
-#include <QHostInfo>
 #include <QTextEdit>     // Include for QTextEdit
 #include <QMenuBar>      // Include for menu bar
 #include <QAction>       // Include for QAction
 #include <QFont>         // Include for QFont
+#include <QThread>
+#include <QRegularExpression>
+#include <QDir>
+#include <QFile>
+
+// Characters that end a word unless backslash-escaped
+static bool isWordBreak(QChar c) {
+    return c.isSpace() || QStringLiteral(";|&<>()").contains(c);
+}
+
+// Backslash-escape a completion so the shell reads it back as one word
+static QString shellEscape(const QString &word) {
+    static const QString special = QStringLiteral(" \t'\"\\$`&;|<>()*?![]{}#");
+    QString escaped;
+    for (const QChar c : word) {
+        if (special.contains(c)) escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
 
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
+    // --- START SHELL FIRST ---
+    // Fork (or attach to) the shell before building any widgets, so it
+    // starts up while the UI is put together. Everything it sends back
+    // arrives through the event loop, after the connects below.
+    session = new SessionClient(this);
+    session->attach("/bin/bash");
+    StartupTrace::mark("shell requested");
+    // --- END START SHELL ---
+
     QWidget *central = new QWidget(this);
     QVBoxLayout *layout = new QVBoxLayout(central);
 
@@ -42,46 +72,120 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     editMenu->addAction(m_settingsAction);
 
     connect(m_settingsAction, &QAction::triggered, this, &MainWindow::showSettingsDialog);
+
+    // Closing the window leaves the shell detached in the daemon; Resume
+    // brings a detached shell back, End Session ends this one for good.
+    m_resumeSessionAction = new QAction("&Resume Detached Session", this);
+    m_resumeSessionAction->setEnabled(false); // Until the daemon reports one
+    m_endSessionAction = new QAction("&End Session", this);
+    QMenu *sessionMenu = menuBar()->addMenu("&Session");
+    sessionMenu->addAction(m_resumeSessionAction);
+    sessionMenu->addAction(m_endSessionAction);
+
+    connect(m_resumeSessionAction, &QAction::triggered, session, &SessionClient::resumeDetached);
+    connect(session, &SessionClient::detachedSessionsChanged, this, [this](int count){
+        m_resumeSessionAction->setEnabled(count > 0);
+    });
+    connect(m_endSessionAction, &QAction::triggered, this, [this](){
+        session->endSession();
+        sessionEnded = true;
+        close();
+    });
     // --- END MENU BAR ---
 
-    backend = new TerminalBackend(this);
-    backend->startShell("/bin/bash");
+    // --- TAB COMPLETION ---
+    // The engine lives on its own thread so listing a huge or network-mounted
+    // directory never blocks typing.
+    completionThread = new QThread(this);
+    completer = new CompletionEngine; // No parent: it's moved to the thread
+    completer->moveToThread(completionThread);
+    connect(completionThread, &QThread::finished, completer, &QObject::deleteLater);
+    connect(completer, &CompletionEngine::completionsReady, this, &MainWindow::applyCompletion);
+    completionThread->start(QThread::LowPriority);
+    QMetaObject::invokeMethod(completer, &CompletionEngine::buildPathIndex, Qt::QueuedConnection);
+    // --- END TAB COMPLETION ---
 
-    backend->sendCommand(getCwdCommand());
+    StartupTrace::mark("widgets built");
 
-    // Fallback timer
-    QTimer::singleShot(500, this, [this](){
-        if(currentDir.isEmpty()) {
-            QString procCwd = backend->getCwdFromProc();
-            if (!procCwd.isEmpty()) {
-                currentDir = procCwd;
-                updatePrompt();
-                outputBox->append(QString("<i>Note: CWD set via /proc fallback: %1</i>").arg(procCwd));
-            }
+    // CONNECTS
+    connect(session, &SessionClient::attached, this, [this](bool resumed){
+        StartupTrace::mark(resumed ? "shell attached (resumed)" : "shell attached");
+
+        // Switching shells (Session > Resume): keep the old one's scrollback
+        // for whoever resumes it next, then start over.
+        if (!attachedKey.isEmpty() && attachedKey != session->sessionKey()) {
+            saveSnapshot(attachedKey, !sessionEnded);
+            clearSession();
+        }
+        attachedKey = session->sessionKey();
+
+        // A resumed shell may be busy running something; don't type into it.
+        // Its window's scrollback and history come back from its snapshot,
+        // then the daemon replays whatever it printed since.
+        if (resumed) {
+            restoreDetachedSnapshot();
+        } else {
+            provisionalDir = restoreSnapshot();
+            session->sendCommand(getCwdCommand());
+        }
+        StartupTrace::mark("snapshot restored");
+
+        // Until the shell reports its directory (OSC 7), show where it is
+        // probably headed, marked as not yet confirmed.
+        if (currentDir.isEmpty()) {
+            if (provisionalDir.isEmpty()) provisionalDir = session->getCwdFromProc();
+            updatePrompt();
+        }
+    });
+
+    connect(outputBox->verticalScrollBar(), &QScrollBar::valueChanged, this, [this](int value){
+        if (value == outputBox->verticalScrollBar()->minimum()) {
+            loadOlderSnapshotLines();
         }
     });
 
-    // CONNECTS
     // Connect to the new readyReadHtml signal
-    connect(backend, &TerminalBackend::readyReadHtml, this, [this](const QString &html){
+    connect(session, &SessionClient::readyReadHtml, this, [this](const QString &html){
         outputBox->moveCursor(QTextCursor::End);
         outputBox->insertHtml(html); // Use insertHtml
         outputBox->verticalScrollBar()->setValue(outputBox->verticalScrollBar()->maximum());
     });
 
-    connect(backend, &TerminalBackend::pwdOutput, this, [this](const QString &dir){
+    connect(session, &SessionClient::pwdOutput, this, [this](const QString &dir){
+        if (dir != currentDir) {
+            // List the new directory now, so the first Tab there is instant
+            QMetaObject::invokeMethod(completer, [engine = completer, dir](){
+                engine->prefetch(dir);
+            }, Qt::QueuedConnection);
+        }
         currentDir = dir;
         updatePrompt();
+        // The shell has run and answered: this is the real first prompt.
+        StartupTrace::finish("first prompt");
     });
 
-    connect(backend, &TerminalBackend::shellExited, this, [this](){
-        QString finalCwd = backend->getCwdFromProc();
+    connect(session, &SessionClient::shellExited, this, [this](){
+        sessionEnded = true;
+        QString finalCwd = session->getCwdFromProc();
         outputBox->append(QString("<br><i>--- Shell process exited. Final directory: %1 ---</i>").arg(finalCwd));
         inputBox->setEnabled(false);
     });
 }
 
-MainWindow::~MainWindow() { /* QObject hierarchy will delete children */ }
+MainWindow::~MainWindow() {
+    // Save this session, including restored history that was never
+    // scrolled into view. The shell itself is not ended: it stays detached
+    // in the daemon for Session > Resume, and its snapshot with it.
+    // (A window closed before its shell attached has nothing to save.)
+    if (!attachedKey.isEmpty()) {
+        const bool detached = !sessionEnded && session->outlivesWindow();
+        saveSnapshot(attachedKey, detached);
+        if (detached) session->detach();
+    }
+
+    completionThread->quit();
+    completionThread->wait();
+}
 
 // New slot to show the settings dialog
 void MainWindow::showSettingsDialog()
@@ -89,22 +193,106 @@ void MainWindow::showSettingsDialog()
     SettingsDialog dialog(this);
     // dialog.exec() shows the window modally
     if (dialog.exec() == QDialog::Accepted) {
-        // User clicked OK, so settings were saved.
-        // Tell the backend to reload the new colors.
-        backend->loadColorSettings();
+        // User clicked OK, so settings were saved and synced to disk.
+        // Tell the backend (every shell, in the daemon) to reload them.
+        session->loadColorSettings();
+    }
+}
+
+// Base format for restored text, matching the live output
+static QTextCharFormat snapshotFormat() {
+    QTextCharFormat format;
+    format.setFont(QFont("Monospace"));
+    return format;
+}
+
+QString MainWindow::restoreSnapshot() {
+    snapshot = new SessionSnapshot(this);
+    if (!snapshot->claimLatest()) {
+        delete snapshot;
+        snapshot = nullptr;
+        return QString();
+    }
+    showSnapshot();
+
+    const QString dir = snapshot->cwd();
+    if (dir.isEmpty() || !QDir(dir).exists()) return QString();
+    session->sendCommand("cd " + shellEscape(dir));
+    return dir;
+}
+
+void MainWindow::restoreDetachedSnapshot() {
+    // Left on disk until this window saves over it: if we crash, the next
+    // window resumes the shell and needs it again.
+    snapshot = new SessionSnapshot(this);
+    if (!snapshot->load(SessionSnapshot::pathFor(attachedKey, true))) {
+        delete snapshot;
+        snapshot = nullptr;
+        return;
     }
+    showSnapshot();
+}
+
+void MainWindow::showSnapshot() {
+    history = snapshot->history();
+
+    // Only the visible tail is rendered; the rest stays in the mapped file.
+    snapshotFirstLoaded = qMax(0, snapshot->lineCount() - kSnapshotPageLines);
+    QTextCursor cursor(outputBox->document());
+    snapshot->renderLines(cursor, snapshotFirstLoaded, snapshot->lineCount(), snapshotFormat());
+    outputBox->verticalScrollBar()->setValue(outputBox->verticalScrollBar()->maximum());
+}
+
+void MainWindow::saveSnapshot(const QString &key, bool detached) {
+    SessionSnapshot::save(SessionSnapshot::pathFor(key, detached), outputBox->document(),
+                          currentDir, history, snapshot, snapshotFirstLoaded);
+    // An ended session's detached copy is superseded (and maybe still
+    // mapped as snapshot; the mapping outlives the name).
+    if (!detached) QFile::remove(SessionSnapshot::pathFor(key, true));
+}
+
+void MainWindow::clearSession() {
+    outputBox->clear();
+    delete snapshot;
+    snapshot = nullptr;
+    snapshotFirstLoaded = 0;
+    history.clear();
+    historyIndex = -1;
+    currentDir.clear();
+    provisionalDir.clear();
+    sessionEnded = false;
+    inputBox->setEnabled(true);
+}
+
+void MainWindow::loadOlderSnapshotLines() {
+    if (!snapshot || snapshotFirstLoaded == 0 || loadingSnapshotPage) return;
+    loadingSnapshotPage = true;
+
+    QScrollBar *bar = outputBox->verticalScrollBar();
+    const int oldMaximum = bar->maximum();
+
+    const int first = qMax(0, snapshotFirstLoaded - kSnapshotPageLines);
+    QTextCursor cursor(outputBox->document());
+    snapshot->renderLines(cursor, first, snapshotFirstLoaded, snapshotFormat());
+    snapshotFirstLoaded = first;
+
+    // Keep the line that was at the top of the view in place
+    bar->setValue(bar->maximum() - oldMaximum);
+    loadingSnapshotPage = false;
 }
 
 // Helper function to build the CWD command
 QString MainWindow::getCwdCommand() const {
-    QString hostname = QHostInfo::localHostName();
-    // This command prints the OSC 7 sequence to stdout for our parser
-    return QString("printf \"\\033]7;file://%1%s\\007\" \"$PWD\"").arg(hostname);
+    // This command prints the OSC 7 sequence to stdout for our parser.
+    // The shell fills in its own $HOSTNAME; no lookup on our side.
+    return QStringLiteral("printf \"\\033]7;file://%s%s\\007\" \"$HOSTNAME\" \"$PWD\"");
 }
 
 void MainWindow::updatePrompt() {
     if(!currentDir.isEmpty()){
         inputBox->setPlaceholderText(QString("[%1] $").arg(currentDir));
+    } else if(!provisionalDir.isEmpty()){
+        inputBox->setPlaceholderText(QString("[%1] $ (starting...)").arg(provisionalDir));
     } else {
         inputBox->setPlaceholderText("$");
     }
@@ -113,7 +301,7 @@ void MainWindow::updatePrompt() {
 // Function to handle command logic
 void MainWindow::handleCommand(const QString &cmd) {
     if(cmd.isEmpty()) {
-        backend->sendCommand(getCwdCommand());
+        session->sendCommand(getCwdCommand());
         return;
     }
 
@@ -132,19 +320,86 @@ void MainWindow::handleCommand(const QString &cmd) {
     outputBox->verticalScrollBar()->setValue(outputBox->verticalScrollBar()->maximum());
 
     if(cmd == "clear" || cmd == "reset") {
+        snapshotFirstLoaded = 0; // Older restored history is gone too
         outputBox->clear();
         inputBox->clear();
         updatePrompt();
-        backend->sendCommand(cmd);
+        session->clearScrollback();
+        session->sendCommand(cmd);
         return;
     }
 
     QString fullCommand = QString("%1; %2").arg(cmd).arg(getCwdCommand());
-    backend->sendCommand(fullCommand);
+    session->sendCommand(fullCommand);
     inputBox->clear();
 }
 
 
+void MainWindow::requestCompletion() {
+    const QString text = inputBox->toPlainText();
+    const int cursorPos = inputBox->textCursor().position();
+
+    // Walk back to the start of the word under the cursor
+    int start = cursorPos;
+    while (start > 0 && !(isWordBreak(text.at(start - 1))
+                          && !(start >= 2 && text.at(start - 2) == '\\'))) {
+        --start;
+    }
+
+    static const QRegularExpression escapeRe("\\\\(.)");
+    QString word = text.mid(start, cursorPos - start);
+    word.replace(escapeRe, "\\1");
+
+    // First word of a command: nothing before it but a separator
+    const QString before = text.left(start).trimmed();
+    const bool commandPosition = before.isEmpty() || isWordBreak(before.back());
+
+    completionText = text;
+    completionCursor = cursorPos;
+    completionWordStart = start;
+    const int requestId = ++completionRequestId;
+    const QString baseDir = currentDir;
+
+    CompletionEngine *engine = completer;
+    QMetaObject::invokeMethod(engine, [engine, requestId, word, baseDir, commandPosition](){
+        engine->complete(requestId, word, baseDir, commandPosition);
+    }, Qt::QueuedConnection);
+}
+
+void MainWindow::applyCompletion(int requestId, const QString &word, const QString &completion,
+                                 const QStringList &candidates, int matchCount) {
+    // Drop answers to stale requests, or for text the user has since edited
+    if (requestId != completionRequestId) return;
+    if (inputBox->toPlainText() != completionText
+        || inputBox->textCursor().position() != completionCursor) return;
+    if (matchCount == 0) return;
+
+    if (completion.size() > word.size() || matchCount == 1) {
+        QString insert = shellEscape(completion);
+        if (matchCount == 1 && !completion.endsWith('/')) insert += ' ';
+
+        QTextCursor cursor = inputBox->textCursor();
+        cursor.setPosition(completionWordStart);
+        cursor.setPosition(completionCursor, QTextCursor::KeepAnchor);
+        cursor.insertText(insert);
+        inputBox->setTextCursor(cursor);
+        return;
+    }
+
+    // Nothing left to fill in: list the choices, like a second Tab in bash
+    const int nameStart = word.lastIndexOf('/') + 1;
+    QStringList names;
+    for (const QString &candidate : candidates) {
+        names.append(candidate.mid(nameStart));
+    }
+    QString listing = names.join("  ").toHtmlEscaped();
+    if (matchCount > candidates.size()) {
+        listing += QString(" ... (%1 more)").arg(matchCount - candidates.size());
+    }
+    outputBox->append(QString("<i>%1</i>").arg(listing));
+    outputBox->verticalScrollBar()->setValue(outputBox->verticalScrollBar()->maximum());
+}
+
 // Event filter for multi-line input and history
 bool MainWindow::eventFilter(QObject *obj, QEvent *event){
     if (obj == inputBox && event->type() == QEvent::KeyPress){
@@ -163,6 +418,12 @@ bool MainWindow::eventFilter(QObject *obj, QEvent *event){
             }
         }
 
+        // Tab: complete the word under the cursor
+        if (keyEvent->key() == Qt::Key_Tab) {
+            requestCompletion();
+            return true;
+        }
+
         // History (Up/Down keys)
         if(!history.isEmpty()){
             if (keyEvent->key() == Qt::Key_Up){
@@ -4,10 +4,13 @@
 #include <QMainWindow>
 #include <QPlainTextEdit>
 #include <QStringList>
-#include "terminalbackend.h"
+#include "sessionclient.h"
 
 class QTextEdit;
 class QAction;
+class QThread;
+class CompletionEngine;
+class SessionSnapshot;
 
 class MainWindow : public QMainWindow
 {
@@ -22,12 +25,15 @@ protected:
 
 private slots:
     void showSettingsDialog(); // Slot to open the settings window
+    void applyCompletion(int requestId, const QString &word, const QString &completion,
+                         const QStringList &candidates, int matchCount);
 
 private:
-    TerminalBackend *backend = nullptr;
+    SessionClient *session = nullptr;
     QTextEdit *outputBox = nullptr;      // Changed to QTextEdit for HTML
     QPlainTextEdit *inputBox = nullptr; // For multi-line input
     QString currentDir;
+    QString provisionalDir; // Shown until the shell first reports currentDir
 
     QStringList history;
     int historyIndex = -1;
@@ -37,7 +43,44 @@ private:
 
     void handleCommand(const QString &cmd);
 
+    // Tab completion, computed on completionThread
+    CompletionEngine *completer = nullptr;
+    QThread *completionThread = nullptr;
+    int completionRequestId = 0;
+    QString completionText;     // input text the pending request was made for
+    int completionCursor = 0;
+    int completionWordStart = 0;
+
+    void requestCompletion();
+
+    // The session shown, and whether its shell has ended
+    QString attachedKey;
+    bool sessionEnded = false;
+
+    // Scrollback restored from the last session. Lines before
+    // snapshotFirstLoaded are still only in the mapped file and are
+    // rendered a page at a time as the user scrolls up.
+    SessionSnapshot *snapshot = nullptr;
+    int snapshotFirstLoaded = 0;
+    bool loadingSnapshotPage = false;
+
+    // Fresh shell: restores the newest ended session. Returns the
+    // directory the shell is sent back to, if any.
+    QString restoreSnapshot();
+    // Resumed shell: restores what its window had when it detached
+    void restoreDetachedSnapshot();
+    void showSnapshot();
+    void loadOlderSnapshotLines();
+    // Saves the scrollback shown for session key; see SessionSnapshot::pathFor
+    void saveSnapshot(const QString &key, bool detached);
+    // Empties the window for another session (Session > Resume)
+    void clearSession();
+
+    static constexpr int kSnapshotPageLines = 500;
+
     QAction *m_settingsAction; // Menu action for settings
+    QAction *m_endSessionAction; // Ends the shell, then closes the window
+    QAction *m_resumeSessionAction; // Switches to a detached shell
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,232 @@
+#include "sessionclient.h"
+#include "sessionprotocol.h"
+#include "terminalbackend.h"
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QProcess>
+#include <QTimer>
+#include <QUuid>
+#include <utility>
+
+using namespace SessionProtocol;
+
+SessionClient::SessionClient(QObject *parent) : QObject(parent) {}
+
+SessionClient::~SessionClient() { /* QObject hierarchy will delete children */ }
+
+void SessionClient::attach(const QString &shellPath) {
+    this->shellPath = shellPath;
+    daemonPath = socketPath();
+    if (daemonPath.isEmpty()) {
+        runLocally();
+        return;
+    }
+
+    // Nothing here waits: the outcome arrives as connected or
+    // errorOccurred, possibly before connectToServer() even returns.
+    socket = new QLocalSocket(this);
+    connect(socket, &QLocalSocket::connected, this, &SessionClient::handleConnected);
+    connect(socket, &QLocalSocket::errorOccurred, this, &SessionClient::handleConnectError);
+    connecting = true;
+    socket->connectToServer(daemonPath);
+}
+
+void SessionClient::handleConnected() {
+    connecting = false;
+
+    // Whoever is listening gets every command we type; make sure it's us.
+    if (!peerIsSameUser(socket->socketDescriptor())) {
+        qWarning() << "Session socket is owned by another user; not using it";
+        runLocally();
+        return;
+    }
+
+    connect(socket, &QLocalSocket::readyRead, this, &SessionClient::handleSocketData);
+    connect(socket, &QLocalSocket::disconnected, this, [this](){
+        // The daemon died underneath us; the shell went with it.
+        if (!shellRunning) return;
+        shellRunning = false;
+        emit shellExited();
+    });
+    // A fresh shell starts where this window was launched, as it would
+    // in-process, not wherever the daemon happened to be started.
+    socket->write(encode(Attach, QDir::currentPath(), QProcess::systemEnvironment()));
+    for (const QString &command : std::as_const(pendingCommands)) {
+        socket->write(encode(Command, command));
+    }
+    pendingCommands.clear();
+}
+
+void SessionClient::handleConnectError(QLocalSocket::LocalSocketError error) {
+    // Errors once connected show up as disconnected() instead.
+    if (!connecting) return;
+
+    if (!daemonStarted) {
+        // No daemon yet. Start one detached so it outlives this window,
+        // then keep knocking while it starts listening.
+        daemonStarted = true;
+        if (!QProcess::startDetached(QCoreApplication::applicationFilePath(), {"--daemon"})) {
+            runLocally();
+            return;
+        }
+        daemonStartTimer.start();
+    } else if (daemonStartTimer.elapsed() >= kDaemonStartTimeoutMs) {
+        qWarning() << "Session daemon did not start listening:" << error;
+        runLocally();
+        return;
+    }
+
+    // Not from inside the socket's own signal
+    QTimer::singleShot(kConnectRetryMs, this, &SessionClient::retryConnect);
+}
+
+void SessionClient::retryConnect() {
+    if (!connecting) return;
+    socket->abort();
+    socket->connectToServer(daemonPath);
+}
+
+void SessionClient::runLocally() {
+    connecting = false;
+    if (socket) {
+        // We may be inside one of its signals
+        socket->disconnect(this);
+        socket->deleteLater();
+        socket = nullptr;
+    }
+
+    qWarning() << "Session daemon unavailable, running shell in-process";
+    startLocalBackend(shellPath);
+    for (const QString &command : std::as_const(pendingCommands)) {
+        localBackend->sendCommand(command);
+    }
+    pendingCommands.clear();
+    key = QUuid::createUuid().toString(QUuid::WithoutBraces);
+    // Queued, like the daemon's reply, so callers can attach before they
+    // connect to our signals.
+    QMetaObject::invokeMethod(this, [this](){ emit attached(false); }, Qt::QueuedConnection);
+}
+
+void SessionClient::startLocalBackend(const QString &shellPath) {
+    localBackend = new TerminalBackend(this);
+    connect(localBackend, &TerminalBackend::readyReadHtml, this, &SessionClient::readyReadHtml);
+    connect(localBackend, &TerminalBackend::pwdOutput, this, [this](const QString &dir){
+        knownCwd = dir;
+        emit pwdOutput(dir);
+    });
+    connect(localBackend, &TerminalBackend::shellExited, this, &SessionClient::shellExited);
+    localBackend->startShell(shellPath);
+}
+
+void SessionClient::handleSocketData() {
+    QDataStream in(socket);
+
+    for (;;) {
+        in.startTransaction();
+        quint8 type = 0;
+        bool resumed = false;
+        QString text;
+        QString screenHtml;
+        quint64 nextChunk = 0;
+        qint32 count = 0;
+        in >> type;
+        if (type == Attached) in >> resumed >> key >> text >> screenHtml >> nextChunk;
+        else if (type == Html || type == Pwd || type == Exited) in >> text;
+        else if (type == DetachedSessions) in >> count;
+        if (!in.commitTransaction()) return;
+
+        switch (type) {
+        case Attached:
+            // Also the answer to resumeDetached(), so forget the old shell
+            knownCwd = text;
+            chunksSeen = nextChunk;
+            shellRunning = true;
+            // attached() first: the window marks the startup trace and sets
+            // up its scrollback before any of the shell's output lands.
+            emit attached(resumed);
+            if (!screenHtml.isEmpty()) emit readyReadHtml(screenHtml);
+            // A fresh shell's directory may just be the one it was forked
+            // in, read before it ran; only its own report counts.
+            if (resumed && !text.isEmpty()) emit pwdOutput(text);
+            break;
+        case Html:
+            ++chunksSeen;
+            emit readyReadHtml(text);
+            break;
+        case Pwd:
+            knownCwd = text;
+            emit pwdOutput(text);
+            break;
+        case Exited:
+            if (!text.isEmpty()) knownCwd = text;
+            // Don't report the exit a second time if the daemon then
+            // quits and drops the connection.
+            shellRunning = false;
+            emit shellExited();
+            break;
+        case DetachedSessions:
+            emit detachedSessionsChanged(count);
+            break;
+        default:
+            qWarning() << "Session client: unknown message" << type;
+            break;
+        }
+    }
+}
+
+void SessionClient::sendCommand(const QString &command) {
+    if (connecting) pendingCommands.append(command);
+    else if (localBackend) localBackend->sendCommand(command);
+    else if (socket) socket->write(encode(Command, command));
+}
+
+void SessionClient::clearScrollback() {
+    if (socket) socket->write(encode(ClearScrollback));
+}
+
+void SessionClient::loadColorSettings() {
+    // Remote output is turned into HTML by the daemon, so it has to
+    // reload the palette itself.
+    if (localBackend) localBackend->loadColorSettings();
+    else if (socket) socket->write(encode(ReloadColors));
+}
+
+void SessionClient::endSession() {
+    if (!socket || socket->state() != QLocalSocket::ConnectedState) return;
+    shellRunning = false;
+    socket->write(encode(Close));
+    socket->waitForBytesWritten(100);
+    socket->disconnectFromServer();
+}
+
+void SessionClient::detach() {
+    if (!outlivesWindow()) return;
+    shellRunning = false;
+    socket->write(encode(Detach, chunksSeen));
+    socket->waitForBytesWritten(100);
+    socket->disconnectFromServer();
+}
+
+void SessionClient::resumeDetached() {
+    if (socket && socket->state() == QLocalSocket::ConnectedState) {
+        socket->write(encode(Resume));
+    }
+}
+
+bool SessionClient::outlivesWindow() const {
+    return socket && socket->state() == QLocalSocket::ConnectedState && shellRunning;
+}
+
+QString SessionClient::sessionKey() const {
+    return key;
+}
+
+QString SessionClient::getCwdFromProc() const {
+    if (localBackend) {
+        QString cwd = localBackend->getCwdFromProc();
+        if (!cwd.isEmpty()) return cwd;
+    }
+    return knownCwd;
+}
@@ -0,0 +1,96 @@
+#ifndef SESSIONCLIENT_H
+#define SESSIONCLIENT_H
+
+#include <QElapsedTimer>
+#include <QLocalSocket>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+class TerminalBackend;
+
+// A window's handle on its shell. Normally the shell lives in the session
+// daemon and this talks to it over a local socket; if the daemon can't be
+// reached it falls back to a TerminalBackend inside this process. Either
+// way it exposes the same signals as TerminalBackend.
+class SessionClient : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SessionClient(QObject *parent = nullptr);
+    ~SessionClient();
+
+    // Connect to (or start) the daemon and take over a shell. Returns
+    // immediately; attached() follows from the event loop once the shell
+    // is ready for commands.
+    void attach(const QString &shellPath);
+
+    void sendCommand(const QString &command);
+    void clearScrollback();
+
+    // End the shell for good.
+    void endSession();
+
+    // Leave the shell running in the daemon, for Session > Resume in this
+    // or a later window. A window that crashes instead leaves its shell
+    // to be taken back by the next window that attaches.
+    void detach();
+
+    // Switch to the most recently detached shell, detaching the current
+    // one. attached(true) follows with the other shell's sessionKey().
+    void resumeDetached();
+
+    // True while the shell lives in the daemon, where detach() keeps it
+    bool outlivesWindow() const;
+
+    // Last directory the shell is known to be in
+    QString getCwdFromProc() const;
+
+    // Identifies the session across windows; valid once attached()
+    QString sessionKey() const;
+
+public slots:
+    void loadColorSettings();
+
+signals:
+    // resumed is true when reattaching to a shell that was already running
+    void attached(bool resumed);
+    void readyReadHtml(const QString &html);
+    void pwdOutput(const QString &dir);
+    void shellExited();
+    // Shells detached in the daemon, available to resumeDetached()
+    void detachedSessionsChanged(int count);
+
+private slots:
+    void handleSocketData();
+    void handleConnected();
+    void handleConnectError(QLocalSocket::LocalSocketError error);
+
+private:
+    QLocalSocket *socket = nullptr;
+    TerminalBackend *localBackend = nullptr;
+    QString knownCwd;
+    QString key;
+    bool shellRunning = false;
+    quint64 chunksSeen = 0; // Html chunks of this shell we've been sent
+
+    // Connection attempt state, until the daemon answers or we give up
+    QString shellPath;
+    QString daemonPath;
+    bool connecting = false;
+    bool daemonStarted = false;
+    QElapsedTimer daemonStartTimer;
+    // Commands typed before there was a shell to send them to
+    QStringList pendingCommands;
+
+    void retryConnect();
+    void runLocally();
+    void startLocalBackend(const QString &shellPath);
+
+    // How long to wait for a freshly started daemon to start listening
+    static constexpr int kDaemonStartTimeoutMs = 2000;
+    // Pause between connection attempts while it starts
+    static constexpr int kConnectRetryMs = 20;
+};
+
+#endif // SESSIONCLIENT_H
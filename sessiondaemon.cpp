@@ -0,0 +1,382 @@
+#include "sessiondaemon.h"
+#include "sessionprotocol.h"
+#include "sessionsnapshot.h"
+#include "terminalbackend.h"
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QProcess>
+#include <QSettings>
+#include <QUuid>
+#include <utility>
+
+using namespace SessionProtocol;
+
+SessionDaemon::SessionDaemon(QObject *parent) : QObject(parent) {
+    server = new QLocalServer(this);
+    server->setSocketOptions(QLocalServer::UserAccessOption);
+    connect(server, &QLocalServer::newConnection,
+            this, &SessionDaemon::handleNewConnection);
+}
+
+SessionDaemon::~SessionDaemon() {
+    // Backends are children of this object, but delete them through
+    // destroySession so each shell is hung up and reaped.
+    while (!sessions.isEmpty()) {
+        destroySession(sessions.first());
+    }
+    if (spare) destroySession(spare);
+}
+
+bool SessionDaemon::listen() {
+    const QString path = socketPath();
+    if (path.isEmpty()) {
+        qWarning() << "Session daemon: no private directory for the socket";
+        return false;
+    }
+
+    // A live daemon answers; a stale socket file from a crash doesn't.
+    QLocalSocket probe;
+    probe.connectToServer(path);
+    if (probe.waitForConnected(100)) {
+        qWarning() << "Session daemon already running";
+        return false;
+    }
+    QLocalServer::removeServer(path);
+
+    if (!server->listen(path)) {
+        qWarning() << "Session daemon failed to listen:" << server->errorString();
+        return false;
+    }
+
+    // Any detached snapshot left on disk belongs to a shell that died with
+    // an earlier daemon; let the next new window restore it.
+    SessionSnapshot::releaseAllDetached();
+
+    spare = spawnSession();
+    return true;
+}
+
+// Variables that differ between launches of the same desktop session and
+// don't matter to a shell, so they don't stop the spare from being used
+static QStringList stableEnvironment(const QStringList &environment)
+{
+    static const QStringList volatileNames = {
+        "DESKTOP_STARTUP_ID", "XDG_ACTIVATION_TOKEN", "WINDOWID", "OLDPWD", "PWD", "SHLVL", "_"
+    };
+    QStringList stable;
+    for (const QString &var : environment) {
+        if (!volatileNames.contains(var.section('=', 0, 0))) stable.append(var);
+    }
+    stable.sort();
+    return stable;
+}
+
+// Single-quote str for the shell
+static QString shellQuote(QString str)
+{
+    return "'" + str.replace("'", "'\\''") + "'";
+}
+
+SessionDaemon::Session *SessionDaemon::spawnSession(const QString &workingDir,
+                                                    const QStringList &environment) {
+    Session *session = new Session;
+    session->key = QUuid::createUuid().toString(QUuid::WithoutBraces);
+    session->startDir = workingDir.isEmpty() ? QDir::currentPath() : workingDir;
+    session->environment = environment.isEmpty() ? QProcess::systemEnvironment() : environment;
+    session->backend = new TerminalBackend(this);
+
+    connect(session->backend, &TerminalBackend::readyReadHtml, this, [this, session](const QString &html){
+        session->scrollback.append(html);
+        if (session->scrollback.size() > kMaxScrollbackChunks) {
+            session->scrollback.removeFirst();
+            ++session->firstChunk;
+        }
+        if (session->client) {
+            session->client->write(encode(Html, html));
+        }
+    });
+
+    connect(session->backend, &TerminalBackend::pwdOutput, this, [this, session](const QString &dir){
+        session->lastCwd = dir;
+        if (session->client) {
+            session->client->write(encode(Pwd, dir));
+        }
+    });
+
+    connect(session->backend, &TerminalBackend::shellExited, this, [this, session](){
+        if (session->client) {
+            // The process is gone, so /proc can't tell us any more.
+            session->client->write(encode(Exited, session->lastCwd));
+            clientSessions.remove(session->client);
+        }
+        // Take it out of reach of attachClient right away.
+        sessions.removeOne(session);
+        if (session == spare) spare = nullptr;
+        // We're inside a backend signal; tear down once it has returned.
+        QMetaObject::invokeMethod(this, [this, session](){
+            destroySession(session);
+            quitIfIdle();
+        }, Qt::QueuedConnection);
+    });
+
+    session->backend->startShell("/bin/bash", workingDir, environment);
+    return session;
+}
+
+void SessionDaemon::destroySession(Session *session) {
+    sessions.removeOne(session);
+    if (session->client) {
+        clientSessions.remove(session->client);
+    } else {
+        // Nobody can resume it now, so its last window's scrollback goes
+        // to the next new window instead. (An attached window saves its
+        // own when it closes.)
+        SessionSnapshot::releaseDetached(session->key);
+    }
+    const bool wasDetached = session->detached;
+    delete session->backend;
+    delete session;
+    if (wasDetached) sendDetachedCount();
+}
+
+void SessionDaemon::handleNewConnection() {
+    while (QLocalSocket *socket = server->nextPendingConnection()) {
+        // The directory is private, but check anyway: never hand a shell
+        // to another user.
+        if (!peerIsSameUser(socket->socketDescriptor())) {
+            qWarning() << "Session daemon: rejecting connection from another user";
+            socket->abort();
+            socket->deleteLater();
+            continue;
+        }
+
+        clients.append(socket);
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket](){
+            handleClientData(socket);
+        });
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket](){
+            handleClientGone(socket);
+        });
+    }
+}
+
+void SessionDaemon::handleClientData(QLocalSocket *socket) {
+    QDataStream in(socket);
+
+    for (;;) {
+        in.startTransaction();
+        quint8 type = 0;
+        QString text;
+        QStringList environment;
+        quint64 seenChunks = 0;
+        in >> type;
+        if (type == Command) in >> text;
+        else if (type == Attach) in >> text >> environment;
+        else if (type == Detach) in >> seenChunks;
+        if (!in.commitTransaction()) return;
+
+        if (type == Attach) {
+            attachClient(socket, text, environment);
+            continue;
+        }
+        if (type == ReloadColors) {
+            reloadColors();
+            continue;
+        }
+        if (type == Resume) {
+            // Also valid once the window's own shell has exited
+            resumeClient(socket);
+            continue;
+        }
+
+        Session *session = clientSessions.value(socket);
+        if (!session) continue;
+
+        switch (type) {
+        case Command:
+            session->backend->sendCommand(text);
+            break;
+        case ClearScrollback:
+            session->firstChunk += quint64(session->scrollback.size());
+            session->scrollback.clear();
+            break;
+        case Close:
+            // The user ended the session explicitly; a plain disconnect
+            // only detaches it (see handleClientGone).
+            clientSessions.remove(socket);
+            session->client = nullptr;
+            destroySession(session);
+            break;
+        case Detach:
+            clientSessions.remove(socket);
+            detachSession(session, seenChunks);
+            break;
+        default:
+            qWarning() << "Session daemon: unknown message" << type;
+            break;
+        }
+    }
+}
+
+void SessionDaemon::reloadColors() {
+    // The window wrote the settings file from its own process; pick up the
+    // change before anyone reads it.
+    QSettings().sync();
+
+    // Every shell shares the settings, and the spare has already read them
+    // on its first output: reload them all, not just the sender's.
+    for (Session *session : std::as_const(sessions)) {
+        session->backend->loadColorSettings();
+    }
+    if (spare) spare->backend->loadColorSettings();
+}
+
+void SessionDaemon::attachClient(QLocalSocket *socket, const QString &cwd,
+                                 const QStringList &environment) {
+    if (clientSessions.contains(socket)) return;
+
+    // Take back a shell whose window vanished without detaching (the GUI
+    // crashed or was killed), so a restarted window picks up where it
+    // left off. Shells detached on purpose wait for an explicit Resume.
+    Session *session = nullptr;
+    for (Session *candidate : std::as_const(sessions)) {
+        if (!candidate->client && !candidate->detached) {
+            session = candidate;
+            break;
+        }
+    }
+
+    const bool resumed = session != nullptr;
+    if (!session) {
+        // The spare was forked for the previous window. A window with
+        // another environment needs a shell of its own; one launched
+        // elsewhere just sends the spare to its directory.
+        if (spare && stableEnvironment(spare->environment) != stableEnvironment(environment)) {
+            destroySession(spare);
+            spare = nullptr;
+        }
+        if (spare) {
+            session = spare;
+            if (!cwd.isEmpty() && cwd != session->startDir) {
+                session->backend->sendCommand("cd -- " + shellQuote(cwd));
+                session->lastCwd = cwd;
+            }
+        } else {
+            session = spawnSession(cwd, environment);
+        }
+        sessions.append(session);
+        // Most likely the next window is launched the same way
+        spare = spawnSession(cwd, environment);
+    }
+    bindClient(socket, session, resumed);
+}
+
+void SessionDaemon::resumeClient(QLocalSocket *socket) {
+    // The most recently detached shell; sessions keeps them in that order.
+    Session *chosen = nullptr;
+    for (auto it = sessions.crbegin(); it != sessions.crend(); ++it) {
+        if ((*it)->detached) {
+            chosen = *it;
+            break;
+        }
+    }
+    if (!chosen) return; // Another window got there first
+
+    Session *current = clientSessions.take(socket);
+    bindClient(socket, chosen, true);
+    if (current) {
+        // Every chunk written so far reaches the window ahead of Attached,
+        // so it has seen them all.
+        detachSession(current, current->firstChunk + quint64(current->scrollback.size()));
+    }
+}
+
+void SessionDaemon::bindClient(QLocalSocket *socket, Session *session, bool resumed) {
+    session->client = socket;
+    session->detached = false;
+    clientSessions.insert(socket, session);
+
+    QString cwd = session->lastCwd;
+    if (cwd.isEmpty()) cwd = session->backend->getCwdFromProc();
+    const quint64 nextChunk = session->firstChunk + quint64(session->scrollback.size());
+    socket->write(encode(Attached, resumed, session->key, cwd,
+                         resumed ? replay(session) : screenTail(session), nextChunk));
+    sendDetachedCount();
+}
+
+void SessionDaemon::detachSession(Session *session, quint64 seenChunks) {
+    session->client = nullptr;
+    session->detached = true;
+    session->seenChunks = qint64(seenChunks);
+    // Newest last, for resumeClient
+    sessions.removeOne(session);
+    sessions.append(session);
+
+    // Don't let shells nobody comes back for pile up forever
+    int detachedCount = 0;
+    for (Session *candidate : std::as_const(sessions)) {
+        if (candidate->detached) ++detachedCount;
+    }
+    for (int i = 0; detachedCount > kMaxDetachedSessions && i < sessions.size(); ) {
+        if (sessions.at(i)->detached) {
+            destroySession(sessions.at(i));
+            --detachedCount;
+        } else {
+            ++i;
+        }
+    }
+    sendDetachedCount();
+}
+
+void SessionDaemon::sendDetachedCount() {
+    qint32 count = 0;
+    for (const Session *session : std::as_const(sessions)) {
+        if (session->detached) ++count;
+    }
+    const QByteArray message = encode(DetachedSessions, count);
+    for (QLocalSocket *socket : std::as_const(clients)) {
+        socket->write(message);
+    }
+}
+
+void SessionDaemon::handleClientGone(QLocalSocket *socket) {
+    // Gone without Detach or Close: the window crashed. Its session waits
+    // for the next window to take it back (see attachClient).
+    if (Session *session = clientSessions.take(socket)) {
+        session->client = nullptr;
+    }
+    clients.removeOne(socket);
+    socket->deleteLater();
+    quitIfIdle();
+}
+
+void SessionDaemon::quitIfIdle() {
+    if (sessions.isEmpty() && clients.isEmpty()) {
+        QCoreApplication::quit();
+    }
+}
+
+QString SessionDaemon::screenTail(const Session *session) const {
+    // Walk back from the end only as far as one screenful, so attaching
+    // costs the same regardless of how much history is kept.
+    int first = session->scrollback.size();
+    int lines = 0;
+    while (first > 0 && lines < kAttachTailLines) {
+        --first;
+        lines += session->scrollback.at(first).count(QLatin1String("<br>"));
+    }
+    return session->scrollback.mid(first).join(QString());
+}
+
+QString SessionDaemon::replay(const Session *session) const {
+    if (session->seenChunks < 0) return screenTail(session);
+
+    // Chunks trimmed by kMaxScrollbackChunks while detached are gone.
+    const qint64 from = qMax(session->seenChunks - qint64(session->firstChunk), qint64(0));
+    if (from >= session->scrollback.size()) return QString();
+    return session->scrollback.mid(int(from)).join(QString());
+}
@@ -0,0 +1,82 @@
+#ifndef SESSIONDAEMON_H
+#define SESSIONDAEMON_H
+
+#include <QObject>
+#include <QList>
+#include <QHash>
+#include <QStringList>
+
+class QLocalServer;
+class QLocalSocket;
+class TerminalBackend;
+
+// Background process (`SplitTerm --daemon`) that owns the PTYs so shells
+// and their scrollback outlive the window showing them. Windows attach
+// over a local socket; see sessionprotocol.h for the messages.
+class SessionDaemon : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SessionDaemon(QObject *parent = nullptr);
+    ~SessionDaemon();
+
+    // Returns false if another daemon already serves this user.
+    bool listen();
+
+private slots:
+    void handleNewConnection();
+
+private:
+    struct Session {
+        TerminalBackend *backend = nullptr;
+        QLocalSocket *client = nullptr; // nullptr while detached
+        QStringList scrollback;         // HTML chunks, oldest first
+        QString lastCwd;
+        QString key;                    // Stable id, names its snapshot file
+        QString startDir;               // Where and with what the shell was forked
+        QStringList environment;
+        // Its window left with Detach (or switched away with Resume). Only
+        // an explicit Resume takes it back; a new window gets a fresh shell.
+        bool detached = false;
+        quint64 firstChunk = 0;         // Sequence number of scrollback.first()
+        qint64 seenChunks = -1;         // Chunks its window had when it detached
+    };
+
+    QLocalServer *server = nullptr;
+    QList<Session *> sessions;
+    QHash<QLocalSocket *, Session *> clientSessions;
+    QList<QLocalSocket *> clients; // Every connected window, shell or not
+
+    // A shell forked ahead of time, handed to the next new window so it
+    // doesn't pay for fork/exec and shell startup.
+    Session *spare = nullptr;
+
+    // Empty workingDir or environment: the daemon's own
+    Session *spawnSession(const QString &workingDir = QString(),
+                          const QStringList &environment = QStringList());
+    void destroySession(Session *session);
+    void attachClient(QLocalSocket *socket, const QString &cwd, const QStringList &environment);
+    void resumeClient(QLocalSocket *socket);
+    void bindClient(QLocalSocket *socket, Session *session, bool resumed);
+    void detachSession(Session *session, quint64 seenChunks);
+    void sendDetachedCount();
+    void reloadColors();
+    void handleClientData(QLocalSocket *socket);
+    void handleClientGone(QLocalSocket *socket);
+    void quitIfIdle();
+
+    // The last screenful of a session's scrollback, sent on attach
+    QString screenTail(const Session *session) const;
+    // What a window resuming session hasn't seen: everything since it
+    // detached, or the last screenful if it never did (it crashed).
+    QString replay(const Session *session) const;
+
+    // Cap on HTML chunks kept per session
+    static constexpr int kMaxScrollbackChunks = 20000;
+    // Lines of scrollback replayed to a window when it attaches
+    static constexpr int kAttachTailLines = 200;
+    // Detached shells kept for Resume; the oldest is ended beyond this
+    static constexpr int kMaxDetachedSessions = 8;
+};
+
+#endif // SESSIONDAEMON_H
@@ -0,0 +1,51 @@
+#include "sessionprotocol.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace SessionProtocol {
+
+// A directory only we can create sockets in: a real directory (not a
+// symlink), owned by us, with no group or other access.
+static bool isPrivateDir(const QString &path)
+{
+    struct stat st;
+    if (lstat(QFile::encodeName(path).constData(), &st) != 0) return false;
+    return S_ISDIR(st.st_mode) && st.st_uid == getuid() && (st.st_mode & 077) == 0;
+}
+
+QString socketPath()
+{
+    const QString runtimeDir = QFile::decodeName(qgetenv("XDG_RUNTIME_DIR"));
+    if (!runtimeDir.isEmpty() && isPrivateDir(runtimeDir)) {
+        return runtimeDir + "/splitterm.sock";
+    }
+
+    // No runtime dir: make our own. If someone else got there first,
+    // isPrivateDir rejects it rather than trusting it.
+    const QString fallbackDir = QDir::tempPath() + QString("/splitterm-%1").arg(getuid());
+    if (mkdir(QFile::encodeName(fallbackDir).constData(), 0700) != 0 && errno != EEXIST) {
+        return QString();
+    }
+    if (!isPrivateDir(fallbackDir)) {
+        qWarning() << "Refusing to use" << fallbackDir << "for the session socket: not a private directory";
+        return QString();
+    }
+    return fallbackDir + "/splitterm.sock";
+}
+
+bool peerIsSameUser(qintptr socketDescriptor)
+{
+    struct ucred cred;
+    socklen_t length = sizeof(cred);
+    if (getsockopt(int(socketDescriptor), SOL_SOCKET, SO_PEERCRED, &cred, &length) != 0) {
+        return false;
+    }
+    return cred.uid == getuid();
+}
+
+} // namespace SessionProtocol
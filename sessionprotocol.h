@@ -0,0 +1,58 @@
+#ifndef SESSIONPROTOCOL_H
+#define SESSIONPROTOCOL_H
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QString>
+
+// Wire format between a SplitTerm window (SessionClient) and the session
+// daemon (SessionDaemon). Every message is a quint8 type followed by the
+// fields listed next to it, serialized with QDataStream.
+namespace SessionProtocol {
+
+enum MessageType : quint8 {
+    // Window -> daemon
+    Attach = 1,         // QString cwd, QStringList environment - of the
+                        //   window, for a fresh shell; answered with Attached
+    Command,            // QString command
+    ReloadColors,       // (none)
+    ClearScrollback,    // (none)
+    Close,              // (none) - end the shell (Session > End Session)
+    Detach,             // quint64 chunksSeen - window closing; keep the shell
+                        //   for Resume. chunksSeen is Attached's nextChunk
+                        //   plus the Html messages received since.
+    Resume,             // (none) - switch to the most recently detached shell
+                        //   (Session > Resume); daemon answers with Attached
+
+    // Daemon -> window
+    Attached = 64,      // bool resumed, QString sessionKey, QString cwd,
+                        //   QString screenHtml, quint64 nextChunk
+    Html,               // QString html
+    Pwd,                // QString dir
+    Exited,             // QString finalCwd
+    DetachedSessions    // qint32 count - shells waiting for a Resume
+};
+
+// Full path of the per-user daemon socket, inside $XDG_RUNTIME_DIR or,
+// failing that, a 0700 directory in the temp dir that we own. Returns an
+// empty string if no such private directory is available: a socket in a
+// shared directory could be planted by another user.
+QString socketPath();
+
+// True if the process at the other end of a connected local socket runs
+// as the same user as us (SO_PEERCRED).
+bool peerIsSameUser(qintptr socketDescriptor);
+
+template <typename... Fields>
+inline QByteArray encode(MessageType type, const Fields &...fields)
+{
+    QByteArray message;
+    QDataStream out(&message, QIODevice::WriteOnly);
+    out << quint8(type);
+    (out << ... << fields);
+    return message;
+}
+
+} // namespace SessionProtocol
+
+#endif // SESSIONPROTOCOL_H
@@ -0,0 +1,365 @@
+#include "sessionsnapshot.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QtEndian>
+#include <string.h>
+#include <limits>
+
+// Accumulates the sections of a snapshot in memory, one run at a time.
+class SnapshotWriter
+{
+public:
+    SnapshotWriter() { appendLineEntry(); }
+
+    void addRun(const QChar *chars, int length, quint32 rgb, quint32 flags) {
+        if (length <= 0 || skipLines > 0) return;
+        const SessionSnapshot::AttrRun run{ lineLength, quint32(length), rgb, flags };
+        runs.append(reinterpret_cast<const char *>(&run), sizeof(run));
+        text.append(reinterpret_cast<const char *>(chars), length * int(sizeof(QChar)));
+        lineLength += quint32(length);
+        textLength += quint32(length);
+        ++runCount;
+    }
+
+    void endLine() {
+        if (skipLines > 0) {
+            --skipLines;
+            return;
+        }
+        ++lineCount;
+        lineLength = 0;
+        appendLineEntry();
+    }
+
+    // Copies lines [first, last) of an existing snapshot
+    void appendLines(const SessionSnapshot &snapshot, int first, int last) {
+        for (int i = first; i < last; ++i) {
+            quint32 textStart, textEnd, runStart, runEnd;
+            if (snapshot.lineBounds(i, textStart, textEnd, runStart, runEnd)) {
+                const quint32 available = textEnd - textStart;
+                for (quint32 r = runStart; r < runEnd; ++r) {
+                    const SessionSnapshot::AttrRun &run = snapshot.runs[r];
+                    if (run.start > available || run.length > available - run.start) break;
+                    addRun(snapshot.text + textStart + run.start, int(run.length), run.rgb, run.flags);
+                }
+            }
+            endLine();
+        }
+    }
+
+    // Lines still to be dropped from the front (over kMaxSavedLines)
+    int skipLines = 0;
+
+    quint32 lineCount = 0;
+    quint32 runCount = 0;
+    QByteArray lines;
+    QByteArray runs;
+    QByteArray text;
+
+private:
+    quint32 lineLength = 0;
+    quint32 textLength = 0;
+
+    void appendLineEntry() {
+        const SessionSnapshot::LineEntry entry{ textLength, runCount };
+        lines.append(reinterpret_cast<const char *>(&entry), sizeof(entry));
+    }
+};
+
+static void appendString(QByteArray &out, const QString &str)
+{
+    const quint32 length = quint32(str.size());
+    out.append(reinterpret_cast<const char *>(&length), sizeof(length));
+    out.append(reinterpret_cast<const char *>(str.constData()), str.size() * int(sizeof(QChar)));
+}
+
+SessionSnapshot::SessionSnapshot(QObject *parent) : QObject(parent) {}
+
+SessionSnapshot::~SessionSnapshot() {
+    unload();
+}
+
+QString SessionSnapshot::snapshotDir() {
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/sessions";
+}
+
+QString SessionSnapshot::pathFor(const QString &sessionKey, bool detached) {
+    return snapshotDir() + "/" + sessionKey + (detached ? ".detached" : ".snapshot");
+}
+
+void SessionSnapshot::releaseDetached(const QString &sessionKey) {
+    const QString from = pathFor(sessionKey, true);
+    if (!QFile::exists(from)) return;
+    QFile::remove(pathFor(sessionKey));
+    QFile::rename(from, pathFor(sessionKey));
+}
+
+void SessionSnapshot::releaseAllDetached() {
+    const QFileInfoList detached = QDir(snapshotDir()).entryInfoList({ "*.detached" }, QDir::Files);
+    for (const QFileInfo &info : detached) {
+        releaseDetached(info.completeBaseName());
+    }
+}
+
+bool SessionSnapshot::claimLatest() {
+    const QFileInfoList saved = QDir(snapshotDir()).entryInfoList(
+        { "*.snapshot" }, QDir::Files, QDir::Time); // Newest first
+
+    for (const QFileInfo &info : saved) {
+        // rename() is atomic: if another window claimed this one first,
+        // it fails and we move on to the next.
+        const QString claimed = info.absoluteFilePath()
+                                + QString(".restoring-%1").arg(QCoreApplication::applicationPid());
+        if (!QFile::rename(info.absoluteFilePath(), claimed)) continue;
+
+        // The mapping outlives the name. A broken file is dropped too, so
+        // it can't fail every launch.
+        const bool ok = load(claimed);
+        QFile::remove(claimed);
+        if (ok) return true;
+    }
+    return false;
+}
+
+bool SessionSnapshot::save(const QString &path, const QTextDocument *document,
+                           const QString &cwd, const QStringList &history,
+                           const SessionSnapshot *previous, int previousLines) {
+    // Keep only the newest kMaxSavedLines lines: the document's own lines
+    // first, then whatever room is left for older, never-loaded ones.
+    int documentLines = 0;
+    if (!document->isEmpty()) {
+        for (QTextBlock block = document->begin(); block.isValid(); block = block.next()) {
+            documentLines += 1 + block.text().count(QChar::LineSeparator);
+        }
+    }
+
+    SnapshotWriter writer;
+    writer.skipLines = qMax(0, documentLines - kMaxSavedLines);
+
+    if (previous && previous->header) {
+        const int last = qMin(previousLines, previous->lineCount());
+        const int room = qMax(0, kMaxSavedLines - documentLines);
+        writer.appendLines(*previous, qMax(0, last - room), last);
+    }
+
+    if (!document->isEmpty()) {
+        for (QTextBlock block = document->begin(); block.isValid(); block = block.next()) {
+            for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+                const QTextFragment fragment = it.fragment();
+                if (!fragment.isValid()) continue;
+
+                const QTextCharFormat format = fragment.charFormat();
+                quint32 rgb = 0;
+                quint32 flags = 0;
+                if (format.foreground().style() != Qt::NoBrush) {
+                    rgb = format.foreground().color().rgb();
+                    flags |= HasColor;
+                }
+                if (format.fontWeight() >= QFont::Bold) {
+                    flags |= Bold;
+                }
+
+                // <br> from insertHtml ends up as a line separator inside the block
+                const QString fragmentText = fragment.text();
+                int start = 0;
+                for (;;) {
+                    const int separator = fragmentText.indexOf(QChar::LineSeparator, start);
+                    const int end = separator < 0 ? fragmentText.size() : separator;
+                    writer.addRun(fragmentText.constData() + start, end - start, rgb, flags);
+                    if (separator < 0) break;
+                    writer.endLine();
+                    start = separator + 1;
+                }
+            }
+            writer.endLine();
+        }
+    }
+
+    QByteArray strings;
+    appendString(strings, cwd);
+    const quint32 historyCount = quint32(history.size());
+    strings.append(reinterpret_cast<const char *>(&historyCount), sizeof(historyCount));
+    for (const QString &cmd : history) {
+        appendString(strings, cmd);
+    }
+
+    Header header{};
+    header.magic = kMagic;
+    header.version = kVersion;
+    header.lineCount = writer.lineCount;
+    header.runCount = writer.runCount;
+    header.linesOffset = sizeof(Header);
+    header.runsOffset = header.linesOffset + quint64(writer.lines.size());
+    header.textOffset = header.runsOffset + quint64(writer.runs.size());
+    header.stringsOffset = header.textOffset + quint64(writer.text.size());
+    header.fileSize = header.stringsOffset + quint64(strings.size());
+
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    // QSaveFile renames over the old file, so a snapshot that is still
+    // mapped (previous) keeps its contents until it is unmapped.
+    QSaveFile out(path);
+    if (!out.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot write session snapshot" << path << out.errorString();
+        return false;
+    }
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(writer.lines);
+    out.write(writer.runs);
+    out.write(writer.text);
+    out.write(strings);
+    if (!out.commit()) return false;
+
+    // Keep the newest kMaxSnapshots sessions
+    const QFileInfoList saved = QDir(QFileInfo(path).absolutePath()).entryInfoList(
+        { "*.snapshot" }, QDir::Files, QDir::Time);
+    for (int i = kMaxSnapshots; i < saved.size(); ++i) {
+        QFile::remove(saved.at(i).absoluteFilePath());
+    }
+    return true;
+}
+
+bool SessionSnapshot::load(const QString &path) {
+    unload();
+
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    const qint64 size = file.size();
+    if (size < qint64(sizeof(Header))) {
+        unload();
+        return false;
+    }
+
+    data = file.map(0, size);
+    if (!data) {
+        unload();
+        return false;
+    }
+
+    // Only the header and the section bounds are checked here. Checking
+    // every line would fault in the whole file; lineBounds clamps the
+    // lines that are actually drawn or copied.
+    const Header *h = reinterpret_cast<const Header *>(data);
+    const quint64 linesBytes = (quint64(h->lineCount) + 1) * sizeof(LineEntry);
+    const quint64 runsBytes = quint64(h->runCount) * sizeof(AttrRun);
+    if (h->magic != kMagic || h->version != kVersion || h->fileSize != quint64(size)
+        || h->linesOffset != sizeof(Header)
+        || h->runsOffset != h->linesOffset + linesBytes
+        || h->textOffset != h->runsOffset + runsBytes
+        || h->stringsOffset < h->textOffset || h->stringsOffset > quint64(size)
+        || (h->stringsOffset - h->textOffset) % sizeof(QChar) != 0) {
+        qWarning() << "Ignoring unreadable session snapshot" << path;
+        unload();
+        return false;
+    }
+
+    header = h;
+    lines = reinterpret_cast<const LineEntry *>(data + h->linesOffset);
+    runs = reinterpret_cast<const AttrRun *>(data + h->runsOffset);
+    text = reinterpret_cast<const QChar *>(data + h->textOffset);
+
+    // Per-line entries are clamped against this as they're used (lineBounds)
+    const quint64 textLength = (h->stringsOffset - h->textOffset) / sizeof(QChar);
+    textSize = quint32(qMin<quint64>(textLength, std::numeric_limits<quint32>::max()));
+
+    // cwd and history are small; copy them out now
+    const uchar *p = data + h->stringsOffset;
+    const uchar *end = data + size;
+    auto readString = [&p, end](QString &out) {
+        if (end - p < qint64(sizeof(quint32))) return false;
+        const quint32 length = qFromUnaligned<quint32>(p);
+        p += sizeof(quint32);
+        if (quint64(end - p) < quint64(length) * sizeof(QChar)) return false;
+        out.resize(int(length));
+        memcpy(out.data(), p, length * sizeof(QChar));
+        p += length * sizeof(QChar);
+        return true;
+    };
+
+    bool ok = readString(cwdValue);
+    if (ok && end - p >= qint64(sizeof(quint32))) {
+        const quint32 count = qFromUnaligned<quint32>(p);
+        p += sizeof(quint32);
+        for (quint32 i = 0; ok && i < count; ++i) {
+            QString cmd;
+            ok = readString(cmd);
+            if (ok) historyValue.append(cmd);
+        }
+    } else {
+        ok = false;
+    }
+
+    if (!ok) {
+        unload();
+        return false;
+    }
+    return true;
+}
+
+void SessionSnapshot::unload() {
+    if (data) file.unmap(const_cast<uchar *>(data));
+    if (file.isOpen()) file.close();
+    data = nullptr;
+    header = nullptr;
+    lines = nullptr;
+    runs = nullptr;
+    text = nullptr;
+    textSize = 0;
+    cwdValue.clear();
+    historyValue.clear();
+}
+
+bool SessionSnapshot::lineBounds(int i, quint32 &textStart, quint32 &textEnd,
+                                 quint32 &runStart, quint32 &runEnd) const {
+    textStart = qMin(lines[i].textStart, textSize);
+    textEnd = qMin(lines[i + 1].textStart, textSize);
+    runStart = qMin(lines[i].runStart, header->runCount);
+    runEnd = qMin(lines[i + 1].runStart, header->runCount);
+    return textStart <= textEnd && runStart <= runEnd;
+}
+
+int SessionSnapshot::lineCount() const {
+    return header ? int(header->lineCount) : 0;
+}
+
+QString SessionSnapshot::cwd() const {
+    return cwdValue;
+}
+
+QStringList SessionSnapshot::history() const {
+    return historyValue;
+}
+
+void SessionSnapshot::renderLines(QTextCursor &cursor, int first, int last,
+                                  const QTextCharFormat &baseFormat) const {
+    if (!header) return;
+    first = qMax(first, 0);
+    last = qMin(last, lineCount());
+
+    cursor.beginEditBlock();
+    for (int i = first; i < last; ++i) {
+        quint32 textStart, textEnd, runStart, runEnd;
+        if (lineBounds(i, textStart, textEnd, runStart, runEnd)) {
+            const quint32 available = textEnd - textStart;
+            for (quint32 r = runStart; r < runEnd; ++r) {
+                const AttrRun &run = runs[r];
+                if (run.start > available || run.length > available - run.start) break;
+
+                QTextCharFormat format = baseFormat;
+                if (run.flags & HasColor) format.setForeground(QColor::fromRgb(run.rgb));
+                if (run.flags & Bold) format.setFontWeight(QFont::Bold);
+                cursor.insertText(QString(text + textStart + run.start, int(run.length)), format);
+            }
+        }
+        cursor.insertBlock();
+    }
+    cursor.endEditBlock();
+}
@@ -0,0 +1,129 @@
+#ifndef SESSIONSNAPSHOT_H
+#define SESSIONSNAPSHOT_H
+
+#include <QObject>
+#include <QFile>
+#include <QStringList>
+
+class QTextCharFormat;
+class QTextCursor;
+class QTextDocument;
+
+// Binary snapshot of a window's session: scrollback lines with their
+// attribute runs, working directory and command history. Loading maps the
+// file instead of reading it, and lines are rendered straight into a
+// QTextCursor as formatted text (no HTML, no escape sequences), so only the
+// pages actually shown are ever touched.
+//
+// Layout (native byte order, it's a local cache):
+//   Header
+//   LineEntry[lineCount + 1]   text and run start of each line
+//   AttrRun[runCount]
+//   QChar text[]               all lines back to back, UTF-16
+//   strings                    cwd, then history, each as quint32 length + UTF-16
+class SessionSnapshot : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SessionSnapshot(QObject *parent = nullptr);
+    ~SessionSnapshot();
+
+    // Where the session with this key (SessionClient::sessionKey) is saved.
+    // A detached session, whose shell still runs in the daemon, is saved
+    // apart so that only a window resuming that shell restores it.
+    static QString pathFor(const QString &sessionKey, bool detached = false);
+
+    // The detached session's shell has ended: hand its snapshot to the
+    // next new window (claimLatest) instead.
+    static void releaseDetached(const QString &sessionKey);
+    static void releaseAllDetached();
+
+    // Writes lines [0, previousLines) of previous (history that was never
+    // loaded into the document), followed by every line of document. Only
+    // the newest kMaxSavedLines of those are kept.
+    static bool save(const QString &path, const QTextDocument *document,
+                     const QString &cwd, const QStringList &history,
+                     const SessionSnapshot *previous = nullptr, int previousLines = 0);
+
+    // Maps path and checks its header. Returns false for a missing, foreign
+    // or outdated file.
+    bool load(const QString &path);
+
+    // Loads the newest saved session no other window has taken, and
+    // removes it from disk so no other window can restore it too.
+    bool claimLatest();
+
+    int lineCount() const;
+    QString cwd() const;
+    QStringList history() const;
+
+    // Inserts lines [first, last) at cursor, one block per line, with each
+    // run's color and weight applied on top of baseFormat
+    void renderLines(QTextCursor &cursor, int first, int last,
+                     const QTextCharFormat &baseFormat) const;
+
+private:
+    struct Header {
+        quint32 magic;
+        quint32 version;
+        quint32 lineCount;
+        quint32 runCount;
+        quint64 linesOffset;
+        quint64 runsOffset;
+        quint64 textOffset;
+        quint64 stringsOffset;
+        quint64 fileSize;
+    };
+
+    struct LineEntry {
+        quint32 textStart;  // in QChars from the start of the text section
+        quint32 runStart;   // index into the run table
+    };
+
+    struct AttrRun {
+        quint32 start;      // in QChars from the start of the line
+        quint32 length;
+        quint32 rgb;
+        quint32 flags;
+    };
+
+    enum RunFlag : quint32 {
+        HasColor = 0x1,
+        Bold = 0x2
+    };
+
+    static constexpr quint32 kMagic = 0x53535453; // "STSS"
+    static constexpr quint32 kVersion = 1;
+    // Lines a snapshot keeps. Room for twice the million-line sessions
+    // snapshots are meant to restore; only past this are the oldest lines
+    // dropped. Saving copies every kept line, unloaded ones straight from
+    // the mapping, so this also bounds the cost of each save.
+    static constexpr int kMaxSavedLines = 2000000;
+    // Saved sessions kept on disk; older ones are deleted
+    static constexpr int kMaxSnapshots = 16;
+
+    static QString snapshotDir();
+
+    friend class SnapshotWriter;
+
+    QFile file;
+    const uchar *data = nullptr;
+    const Header *header = nullptr;
+    const LineEntry *lines = nullptr;
+    const AttrRun *runs = nullptr;
+    const QChar *text = nullptr;
+    quint32 textSize = 0; // QChars in the text section
+
+    QString cwdValue;
+    QStringList historyValue;
+
+    void unload();
+
+    // Text and run range of line i, clamped to their sections so a damaged
+    // file can't send us past the mapping. False if the entries are out of
+    // order; the line is then skipped.
+    bool lineBounds(int i, quint32 &textStart, quint32 &textEnd,
+                    quint32 &runStart, quint32 &runEnd) const;
+};
+
+#endif // SESSIONSNAPSHOT_H
@@ -53,6 +53,54 @@ void SettingsDialog::loadSettings()
 
         updateButtonColor(button, color);
     }
+
+    loadHighlightRules();
+}
+
+void SettingsDialog::loadHighlightRules()
+{
+    // Shown as editable text, one "pattern #color" rule per line
+    QStringList lines;
+    int count = m_settings.beginReadArray("highlights");
+    for (int i = 0; i < count; ++i) {
+        m_settings.setArrayIndex(i);
+        QString pattern = m_settings.value("pattern").toString();
+        QColor color = m_settings.value("color").value<QColor>();
+        lines.append(QString("%1 %2").arg(pattern, color.name()));
+    }
+    m_settings.endArray();
+
+    ui->highlightRulesEdit->setPlainText(lines.join('\n'));
+}
+
+void SettingsDialog::saveHighlightRules()
+{
+    // The last word of each line is the color; everything before it is
+    // the text to match. Lines without a valid color are skipped.
+    QList<QPair<QString, QColor>> rules;
+    const QStringList lines = ui->highlightRulesEdit->toPlainText().split('\n');
+    for (const QString &line : lines) {
+        QString trimmed = line.trimmed();
+        int split = trimmed.lastIndexOf(' ');
+        if (split <= 0) continue;
+
+        QString pattern = trimmed.left(split).trimmed();
+        QColor color(trimmed.mid(split + 1));
+        if (pattern.isEmpty() || !color.isValid()) {
+            qDebug() << "Skipping highlight rule:" << line;
+            continue;
+        }
+        rules.append({ pattern, color });
+    }
+
+    m_settings.remove("highlights");
+    m_settings.beginWriteArray("highlights");
+    for (int i = 0; i < rules.size(); ++i) {
+        m_settings.setArrayIndex(i);
+        m_settings.setValue("pattern", rules[i].first);
+        m_settings.setValue("color", rules[i].second);
+    }
+    m_settings.endArray();
 }
 
 void SettingsDialog::saveSettings()
@@ -64,6 +112,12 @@ void SettingsDialog::saveSettings()
 
         m_settings.setValue(key, color);
     }
+
+    saveHighlightRules();
+
+    // The session daemon reloads these from its own process as soon as the
+    // dialog is accepted, so they must be on disk by then.
+    m_settings.sync();
 }
 
 void SettingsDialog::onColorButtonClicked()
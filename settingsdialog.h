@@ -29,6 +29,8 @@ private slots:
 
 private:
     void loadSettings();
+    void loadHighlightRules();
+    void saveHighlightRules();
     void updateButtonColor(QPushButton *button, const QColor &color);
 
     Ui::SettingsDialog *ui;
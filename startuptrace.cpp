@@ -0,0 +1,34 @@
+#include "startuptrace.h"
+#include <QElapsedTimer>
+#include <stdio.h>
+
+namespace StartupTrace {
+
+static bool enabled = false;
+static QElapsedTimer startClock;
+static qint64 lastNs = 0;
+
+void enable() {
+    enabled = true;
+    startClock.start();
+    fprintf(stderr, "[startup] %9s %10s  phase\n", "total ms", "+ms");
+}
+
+void mark(const char *phase) {
+    if (!enabled) return;
+    const qint64 nowNs = startClock.nsecsElapsed();
+    fprintf(stderr, "[startup] %9.2f %+10.2f  %s\n",
+            nowNs / 1e6, (nowNs - lastNs) / 1e6, phase);
+    lastNs = nowNs;
+}
+
+void finish(const char *phase) {
+    if (!enabled) return;
+    mark(phase);
+    const double totalMs = startClock.nsecsElapsed() / 1e6;
+    fprintf(stderr, "[startup] %.2f ms to first prompt (budget %.0f ms)%s\n",
+            totalMs, kBudgetMs, totalMs > kBudgetMs ? " - OVER BUDGET" : "");
+    enabled = false;
+}
+
+} // namespace StartupTrace
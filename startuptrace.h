@@ -0,0 +1,23 @@
+#ifndef STARTUPTRACE_H
+#define STARTUPTRACE_H
+
+// Timestamped breakdown of application startup, printed to stderr when
+// SplitTerm is run with --startup-trace. Marks are free when tracing is off.
+namespace StartupTrace {
+
+// Launch should reach the first prompt within this budget
+constexpr double kBudgetMs = 250.0;
+
+// Starts the clock; call first thing in main()
+void enable();
+
+// Prints phase with the time since enable() and since the previous mark
+void mark(const char *phase);
+
+// Marks the last phase and reports the total against kBudgetMs. Later
+// calls to mark() or finish() are ignored.
+void finish(const char *phase);
+
+} // namespace StartupTrace
+
+#endif // STARTUPTRACE_H
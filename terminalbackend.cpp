@@ -9,22 +9,42 @@
 #include <QFile>
 #include <QHostInfo>
 #include <string.h>
+#include <errno.h>
 #include <termios.h>
 #include <QStringBuilder>
 #include <QSettings> // For loading colors
+#include <QTimer>
+#include <vector>
 
 TerminalBackend::TerminalBackend(QObject *parent) : QObject(parent) {
-    // Load colors from QSettings on startup
-    loadColorSettings();
+    // Colors are loaded lazily in processOutputChunk, so constructing a
+    // backend (and forking the shell) doesn't wait on the settings file.
     resetSgrState();
 }
 
+// Reap a child we've hung up on without blocking the event loop. In the
+// session daemon a blocking waitpid() would stall output to every other
+// window. Escalates to SIGKILL if the shell ignores the hangup.
+static void reapChildLater(pid_t pid, int attempt = 0)
+{
+    if (waitpid(pid, nullptr, WNOHANG) != 0) return; // Reaped (or not ours)
+    if (!QCoreApplication::instance()) return;       // Exiting; init reaps it
+
+    if (attempt == 30) kill(pid, SIGKILL); // ~3 s after the hangup
+    QTimer::singleShot(100, QCoreApplication::instance(), [pid, attempt](){
+        reapChildLater(pid, attempt + 1);
+    });
+}
+
 TerminalBackend::~TerminalBackend() {
+    if (notifier) notifier->setEnabled(false);
+    // Closing the master hangs up the terminal, too.
+    if (masterFd >= 0) close(masterFd);
     if (childPid > 0) {
-        kill(childPid, SIGTERM);
-        waitpid(childPid, nullptr, 0);
+        // Interactive bash ignores SIGTERM; SIGHUP ends it and its jobs.
+        kill(childPid, SIGHUP);
+        reapChildLater(childPid);
     }
-    if (masterFd >= 0) close(masterFd);
     if (notifier) notifier->deleteLater();
 }
 
@@ -33,6 +53,7 @@ void TerminalBackend::loadColorSettings()
     // Make sure QCoreApplication::setOrganizationName/setApplicationName was called in main.cpp
     QSettings settings;
     ansiColorMap.clear();
+    colorSettingsLoaded = true;
 
     // Loop through all 16 colors (normal and bright)
     for (int i = 30; i <= 37; ++i) {
@@ -43,25 +64,51 @@ void TerminalBackend::loadColorSettings()
     }
 
     qDebug() << "Loaded" << ansiColorMap.size() << "colors from settings.";
-}
 
+    loadHighlightRules(settings);
+}
 
-void TerminalBackend::startShell(const QString &shellPath) {
-    // Set TTY attributes *before* forking to disable echo
-    struct termios tt;
-    if (tcgetattr(STDIN_FILENO, &tt) < 0) {
-        qWarning() << "tcgetattr failed";
-        return;
+void TerminalBackend::loadHighlightRules(QSettings &settings)
+{
+    // Compile once here, so output is scanned in a single pass no matter
+    // how many rules there are.
+    QList<HighlightMatcher::Rule> rules;
+    int count = settings.beginReadArray("highlights");
+    for (int i = 0; i < count; ++i) {
+        settings.setArrayIndex(i);
+        rules.append({ settings.value("pattern").toString().toUtf8(),
+                       settings.value("color").value<QColor>() });
     }
-    // Unset the ECHO flag. The shell will inherit this.
-    tt.c_lflag &= ~ECHO;
+    settings.endArray();
+
+    highlighter.compile(rules);
+    qDebug() << "Compiled" << rules.size() << "highlight rules.";
+}
+
 
+void TerminalBackend::startShell(const QString &shellPath, const QString &workingDir,
+                                 const QStringList &environment) {
     struct winsize ws{};
     ws.ws_col = 80;
     ws.ws_row = 24;
 
-    // Pass the modified TTY settings (tt) to forkpty
-    childPid = forkpty(&masterFd, nullptr, &tt, &ws);
+    // Convert before forking: the child may only touch memory that is
+    // already valid when fork() returns.
+    const QByteArray bash = shellPath.toUtf8();
+    const QByteArray dir = QFile::encodeName(workingDir);
+    QList<QByteArray> envStrings;
+    std::vector<char *> envp;
+    for (const QString &var : environment) {
+        envStrings.append(var.toLocal8Bit());
+    }
+    for (QByteArray &var : envStrings) {
+        envp.push_back(var.data());
+    }
+    envp.push_back(nullptr);
+
+    // Don't borrow termios from our own stdin: when started from a desktop
+    // launcher or as the session daemon there is no TTY to copy from.
+    childPid = forkpty(&masterFd, nullptr, nullptr, &ws);
 
     if (childPid < 0) {
         qWarning() << "forkpty failed";
@@ -69,10 +116,29 @@ void TerminalBackend::startShell(const QString &shellPath) {
     }
 
     if (childPid == 0) {
+        // The session daemon ignores SIGHUP, and ignored signals survive
+        // exec. The shell must still die when we hang up on it.
+        signal(SIGHUP, SIG_DFL);
+
+        // Unset the ECHO flag on the slave side. The shell inherits this.
+        struct termios tt;
+        if (tcgetattr(STDIN_FILENO, &tt) == 0) {
+            tt.c_lflag &= ~ECHO;
+            tcsetattr(STDIN_FILENO, TCSANOW, &tt);
+        }
+
+        if (!dir.isEmpty() && chdir(dir.constData()) != 0) {
+            // The directory is gone; the shell starts where we are instead.
+        }
+
         // --- FIX 1: Revert to simple execl ---
         // This avoids the "line ending" warning from the shell.
-        const char *bash = shellPath.toUtf8().constData();
-        execl(bash, bash, "--noprofile", "--norc", "-i", nullptr);
+        if (environment.isEmpty()) {
+            execl(bash.constData(), bash.constData(), "--noprofile", "--norc", "-i", nullptr);
+        } else {
+            execle(bash.constData(), bash.constData(), "--noprofile", "--norc", "-i", nullptr,
+                   envp.data());
+        }
         _exit(1);
     } else {
         // Parent process:
@@ -82,14 +148,12 @@ void TerminalBackend::startShell(const QString &shellPath) {
 
         // --- FIX 1 (cont.): Send setup commands via write() ---
         // Now that `termios` handles echo, this is the clean way.
-        const char* bpm_cmd = "bind 'set enable-bracketed-paste off'\n";
-        write(masterFd, bpm_cmd, strlen(bpm_cmd));
-
-        const char* ps1_cmd = "export PS1=''\n";
-        write(masterFd, ps1_cmd, strlen(ps1_cmd));
-
-        const char* ps2_cmd = "export PS2=''\n";
-        write(masterFd, ps2_cmd, strlen(ps2_cmd));
+        // One write, so the shell reads them in a single go.
+        const char* setup_cmds =
+            "bind 'set enable-bracketed-paste off'\n"
+            "export PS1=''\n"
+            "export PS2=''\n";
+        write(masterFd, setup_cmds, strlen(setup_cmds));
     }
 }
 
@@ -116,13 +180,18 @@ void TerminalBackend::handlePtyOutput() {
     char buffer[4096];
     ssize_t n = read(masterFd, buffer, sizeof(buffer));
 
-    if (n < 0) return;
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
 
-    if (n == 0) {
-        emit shellExited();
+    // On Linux the master reads EIO, not EOF, once the shell has exited.
+    // Either way the level-triggered notifier would fire forever.
+    if (n <= 0) {
         notifier->setEnabled(false);
         close(masterFd);
         masterFd = -1;
+        reapChildLater(childPid);
+        childPid = -1;
+        // Last: a receiver may delete us (the daemon ends the session)
+        emit shellExited();
         return;
     }
 
@@ -187,7 +256,38 @@ QString TerminalBackend::parseSgrCodes(const QStringList &codes) {
     return QString();
 }
 
+void TerminalBackend::appendPlainText(QString &html, const QByteArray &bytes) const {
+    auto appendEscaped = [&html](const QByteArray &raw) {
+        QString plainText = QString::fromUtf8(raw);
+
+        // --- FIX 3: Simplify HTML escaping ---
+        // Only escape ampersand and newline
+        plainText.replace(QLatin1String("&"), QLatin1String("&amp;"));
+        plainText.replace(QLatin1String("\n"), QLatin1String("<br>"));
+        plainText.replace(QLatin1String("\r"), QLatin1String("")); // Ignore carriage return
+
+        html.append(plainText);
+    };
+
+    // Matches are found on the raw bytes. Rule patterns are whole UTF-8
+    // strings, so a match never splits a character.
+    int pos = 0;
+    const QList<HighlightMatcher::Overlay> overlays = highlighter.scan(bytes.constData(), bytes.size());
+    for (const HighlightMatcher::Overlay &overlay : overlays) {
+        if (overlay.start > pos) appendEscaped(bytes.mid(pos, overlay.start - pos));
+        html.append(QString("<span style=\"color:%1;\">").arg(overlay.color.name()));
+        appendEscaped(bytes.mid(overlay.start, overlay.length));
+        html.append(QLatin1String("</span>"));
+        pos = overlay.start + overlay.length;
+    }
+    if (pos < bytes.size()) appendEscaped(bytes.mid(pos));
+}
+
 void TerminalBackend::processOutputChunk(const QByteArray &data) {
+    if (!colorSettingsLoaded) {
+        loadColorSettings();
+    }
+
     outputBuffer.append(data);
 
     // This regex finds:
@@ -211,15 +311,7 @@ void TerminalBackend::processOutputChunk(const QByteArray &data) {
 
         // 1. Append any plain text *before* this match
         if (start > lastPos) {
-            QString plainText = QString::fromUtf8(outputBuffer.mid(lastPos, start - lastPos));
-
-            // --- FIX 3: Simplify HTML escaping ---
-            // Only escape ampersand and newline
-            plainText.replace(QLatin1String("&"), QLatin1String("&amp;"));
-            plainText.replace(QLatin1String("\n"), QLatin1String("<br>"));
-            plainText.replace(QLatin1String("\r"), QLatin1String("")); // Ignore carriage return
-
-            htmlChunk.append(plainText);
+            appendPlainText(htmlChunk, outputBuffer.mid(lastPos, start - lastPos));
         }
 
         // 2. Process the matched escape sequence
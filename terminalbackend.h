@@ -7,6 +7,10 @@
 #include <termios.h>
 #include <QColor>
 #include <QHash>
+#include <QStringList>
+#include "highlightmatcher.h"
+
+class QSettings;
 
 class TerminalBackend : public QObject
 {
@@ -15,12 +19,14 @@ public:
     explicit TerminalBackend(QObject *parent = nullptr);
     ~TerminalBackend();
 
-    void startShell(const QString &shellPath);
+    // An empty workingDir or environment means the shell inherits ours
+    void startShell(const QString &shellPath, const QString &workingDir = QString(),
+                    const QStringList &environment = QStringList());
     void sendCommand(const QString &command);
     QString getCwdFromProc() const;
 
 public slots:
-    // Slot to be called when settings change
+    // Slot to be called when settings change (also reloads highlight rules)
     void loadColorSettings();
 
 signals:
@@ -52,6 +58,8 @@ private:
 
     // Map of ANSI codes to colors (loaded from QSettings)
     QHash<int, QColor> ansiColorMap;
+    // Settings are read on the first output chunk, not at construction
+    bool colorSettingsLoaded = false;
 
     // Resets style to default
     void resetSgrState();
@@ -61,6 +69,13 @@ private:
 
     // Helper to generate the current style span
     QString getCurrentStyleHtml() const;
+
+    // User highlight rules, compiled from QSettings "highlights"
+    HighlightMatcher highlighter;
+    void loadHighlightRules(QSettings &settings);
+
+    // Appends escaped plain text, wrapping highlight rule matches in spans
+    void appendPlainText(QString &html, const QByteArray &bytes) const;
 };
 
 #endif // TERMINALBACKEND_H